@@ -0,0 +1,62 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+
+// 写回式块缓存：位于 DiskManager 与镜像文件之间，按块号缓存固定数量的块帧。
+// 修改过的帧带脏标记，淘汰或 sync() 时才写回文件；淘汰顺序为 LRU。
+class BlockCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;        // 命中次数
+        uint64_t misses = 0;      // 未命中，需要从文件读入
+        uint64_t evictions = 0;   // 被淘汰的帧数
+        uint64_t writebacks = 0;  // 写回文件的脏块数
+    };
+
+    // fd 为镜像文件描述符，块 i 位于文件偏移 i * blockSize 处；capacity 为可缓存的块数
+    BlockCache(int fd, int blockSize, int capacity);
+
+    BlockCache(const BlockCache&) = delete;
+    BlockCache& operator=(const BlockCache&) = delete;
+
+    // 返回块帧指针，forWrite 为 true 时标记为脏。
+    // 指针在下一次 get() 之前有效（之后该帧可能被淘汰）。
+    char* get(int blockIdx, bool forWrite);
+
+    // 按块号顺序写回全部脏帧。有块没能完整写入时返回 false：sync 中失败的帧保持为脏，
+    // 淘汰时写回失败的块已无法重写，此后每次 sync 都返回 false
+    bool sync();
+    int dirtyCount() const;
+    int capacity() const;
+    const Stats& stats() const;
+
+private:
+    struct Frame {
+        int block;    // 缓存的块号，-1 表示空闲帧
+        bool dirty;
+        int prev;     // LRU 链表，表头为最近使用
+        int next;
+    };
+
+    int fd;
+    int blockSize;
+    std::vector<char> data;                  // capacity * blockSize 字节的帧数据
+    std::vector<Frame> frames;
+    std::unordered_map<int, int> index;      // 块号 -> 帧号
+    int head;
+    int tail;
+    int used;
+    Stats counters;
+    bool evictFailed;                        // 曾有脏帧在淘汰时写回失败
+
+    void unlink(int f);
+    void pushFront(int f);
+    bool writeBack(int f);      // 写回一帧，未完整写入时返回 false 且帧保持为脏
+    char* frameData(int f);
+};
+
+#endif // BLOCK_CACHE_H
@@ -2,8 +2,13 @@
 #define DIRECTORY_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
+#include <atomic>
+#include <shared_mutex>
+
+#include "name_index.h"
 
 struct DirEntry {
     enum EntryType {
@@ -14,8 +19,8 @@ struct DirEntry {
     std::string name; // 文件或目录名
     int inodeId;      // inode 编号（对文件）或子目录的 inode
 
-    DirEntry(const std::string& n, int id, EntryType t)
-        : type(t), name(n), inodeId(id) {}
+    DirEntry(std::string n, int id, EntryType t)
+        : type(t), name(std::move(n)), inodeId(id) {}
 };
 
 class Directory {
@@ -25,31 +30,70 @@ public:
     Directory* addSubdir(const std::string& name, int inodeId);
     void addFile(const std::string& name, int inodeId);
 
-    Directory* findSubdir(const std::string& name);
-    int findFile(const std::string& name) const;
+    Directory* findSubdir(std::string_view name);
+    int findFile(std::string_view name) const;
 
     void removeSubdir(const std::string& name);
     void removeFile(const std::string& name);
 
+    // 摘下/挂上子目录（连同整棵子树），用于重命名和移动
+    std::unique_ptr<Directory> detachSubdir(const std::string& name);
+    Directory* attachSubdir(std::unique_ptr<Directory> dir, const std::string& name);
+    bool isAncestorOf(const Directory* dir) const;
+
     void listContents() const;
-    std::string getPath() const;
+    const std::string& getPath() const;   // 绝对路径，已缓存
     bool isDirEmpty() const;
 
+    // 依次对每个直接子目录 / 文件项调用 fn
+    template <typename Fn>
+    void forEachSubdir(Fn fn) const {
+        for (const auto& sub : subdirs) fn(sub.get());
+    }
+    template <typename Fn>
+    void forEachFile(Fn fn) const {
+        for (const auto& entry : files) fn(entry);
+    }
+
     Directory* getParent() const;
     const std::string& getName() const;
     int getInodeId() const;
 
-    
-    void serialize(std::ostream& out);
-    void deserialize(std::istream& in);
+    // 保护本目录文件项与子目录表的读写锁，由调用方持有；本类自身不加锁。
+    // 同时锁多个目录时按 inode 号从小到大加锁
+    std::shared_mutex& entryLock() const;
+
+    // 以本目录为工作目录的会话数，不为 0 时不能删除
+    void retainWorkDir();
+    void releaseWorkDir();
+    int workDirRefs() const;
+
+    // 版本 2 元数据：整棵树展开为目录表、文件项表和字符串表，格式见 metadata.h
+    void packTree(std::vector<char>& dirs, std::vector<char>& entries, std::string& strings) const;
+    static std::unique_ptr<Directory> unpackTree(const char* dirs, size_t dirCount,
+                                                 const char* entries, size_t entryCount,
+                                                 std::string_view strings);
+
+    void deserialize(std::istream& in);   // 旧版流式格式，仅用于读取旧的元数据文件
 
 
 private:
     std::string dirName;
+    std::string fullPath;      // 缓存的绝对路径，改名或移动时随子树一起更新
     int inodeId;
     Directory* parentDir;
     std::vector<std::unique_ptr<Directory>> subdirs;
     std::vector<DirEntry> files;
+
+    // 名字到 subdirs/files 下标的哈希索引，与两个数组同步维护
+    NameIndex subdirIndex;
+    NameIndex fileIndex;
+    mutable std::shared_mutex lock;
+    std::atomic<int> workRefs{0};
+
+    int subdirSlot(std::string_view name) const;
+    int fileSlot(std::string_view name) const;
+    void refreshPath();        // 根据父目录重算本目录及子树的 fullPath
 };
 
 #endif // DIRECTORY_H
@@ -8,30 +8,234 @@
  * @date 2025-6-4
  */
 
-#ifndef DISK_H 
+#ifndef DISK_H
 #define DISK_H
 
 #include <string>
 #include <fstream>
 #include <cstring>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
 
+#include "block_cache.h"
+
+// 线程安全：不同线程可以同时分配、释放和读写不同的块。空闲位图按段分片、每片一把锁，
+// 各线程从不同的分片开始分配；脏块与改动集合用原子操作置位；缓存模式下对缓存的访问串行化。
+// 加载、保存、同步、打开/关闭镜像以及 forEach*Run/clear* 须在没有其他线程修改磁盘时调用
 class DiskManager {
 public:
     static constexpr int BLOCK_SIZE = 1024;          // 每块大小为 1024 字节
-    static constexpr int BLOCK_COUNT = 1024;         // 总共 1024 块，共 1MB
+    static constexpr int DEFAULT_BLOCK_COUNT = 1024;  // 默认 1024 块，共 1MB
+
+    explicit DiskManager(int blockCount = DEFAULT_BLOCK_COUNT);
+    ~DiskManager();
+
+    DiskManager(const DiskManager&) = delete;
+    DiskManager& operator=(const DiskManager&) = delete;
+    DiskManager(DiskManager&& other) noexcept;
+    DiskManager& operator=(DiskManager&& other) noexcept;
+
+    void resize(int blockCount);                 // 重新设置磁盘大小，原有数据清空
+    int getBlockCount() const;
+
+    // 从文件加载虚拟磁盘；文件不存在、为空或读不全时返回 false，读了一半时内容不可用
+    bool loadDisk(const std::string& filename);
+    bool saveDisk(const std::string& filename);  // 将虚拟磁盘保存到文件（写临时文件后改名替换）
 
-    DiskManager();
+    // mmap 模式：块直接映射为镜像文件中的页，由系统按需调入。
+    // 文件不存在时按 blockCount 创建；存在时块数由文件大小推出。
+    bool mapDisk(const std::string& filename, int blockCount = DEFAULT_BLOCK_COUNT);
+    // 缓存模式：块数据留在镜像文件中，经容量为 cacheBlocks 的写回缓存访问，
+    // 磁盘可以远大于内存。文件的创建与块数推断同 mapDisk。
+    bool openCached(const std::string& filename, int cacheBlocks, int blockCount = DEFAULT_BLOCK_COUNT);
+    void closeImage();                           // 刷回脏块并关闭镜像文件，回到内存模式
+    // 只把脏块和改动过的位图写回镜像文件；内存模式下写回最近一次加载或整体保存的文件，
+    // 没有这样的文件或写入失败时返回 false
+    bool sync();
+    bool isMapped() const;
+    bool isCached() const;
+    const BlockCache* getCache() const;          // 缓存模式下的缓存（含命中统计），否则为 nullptr
+    const std::string& imageFile() const;
 
-    void loadDisk(const std::string& filename);  // 从文件加载虚拟磁盘
-    void saveDisk(const std::string& filename);  // 将虚拟磁盘保存到文件
+    // 按块号升序遍历自上次保存/同步以来被修改过的连续块区间 [start, start + count)
+    template <typename Fn>
+    void forEachDirtyRun(Fn fn) const {
+        forEachRun(dirtyWords, fn);
+    }
 
+    // 自上次 clearChanges() 以来被修改过的块区间和位图字节区间 [lo, hi)，供预写日志记录增量。
+    // 与脏块集合相互独立：sync/saveDisk 只清脏块，日志提交只清这里
+    template <typename Fn>
+    void forEachChangedRun(Fn fn) const {
+        forEachRun(changedWords, fn);
+    }
+    bool changedBitmapRange(int& lo, int& hi) const;
+    void clearChanges();
+
+    // 新分配的块内容视为全 0，但不立即清零：块被标记为“待清零”，读取时按 0 返回，
+    // 第一次部分写入时才补清零，整块写入则直接覆盖。释放块时默认不擦除内容
     int allocateBlock();      // 分配一个空闲块，返回块索引，失败返回 -1
-    void freeBlock(int idx);  // 释放指定块
-    char* getBlock(int idx);  // 获取块的指针
+    int allocateExtent(int count, int hint = -1); // 分配 count 个连续块，返回起始块，失败返回 -1
+    void freeBlock(int idx);  // 释放指定块；安全擦除模式下先清零
+    void freeExtent(int start, int count);  // 释放连续块 [start, start + count)，每个分片只加一次锁
+    char* getBlock(int idx);  // 获取块的指针（缓存模式下指针只在单线程使用时有效）
+
+    // 安全擦除：释放块时立即把内容清零，避免删除的数据留在镜像中
+    void setSecureErase(bool on);
+    bool secureErase() const;
+    // 把已分配但仍待清零的块真正清零并记为已修改。sync/saveDisk 会自动调用；
+    // 预写日志在记录块改动之前调用，须在没有其他线程修改磁盘时调用
+    void fillPendingZeros();
+
+    // 按字节读写一段连续块，offset 为相对 start 块起始处的偏移
+    bool readBlocks(int start, int offset, int length, char* dst);
+    bool writeBlocks(int start, int offset, int length, const char* src);
+
+    // 按顺序把同样范围的内容分段交给 fn(data, n)，不需要调用方准备整段缓冲区。
+    // 内存和 mmap 模式下直接交出块存储中的指针，整段只回调一次；缓存模式下逐块复制到
+    // 栈上一个块大小的临时区后交出，回调时不持有缓存锁
+    template <typename Fn>
+    bool visitBlocks(int start, int offset, int length, Fn&& fn) {
+        if (!validRange(start, offset, length)) return false;
+        if (length == 0) return true;
+        int first = start + offset / BLOCK_SIZE;
+        int last = start + (offset + length - 1) / BLOCK_SIZE;
+        if (!cache && !anyPendingZero(first, last + 1)) {
+            fn(static_cast<const char*>(base + static_cast<size_t>(start) * BLOCK_SIZE + offset), length);
+            return true;
+        }
+        // 待清零的块交出静态的全 0 块
+        char copy[BLOCK_SIZE];
+        int inBlock = offset % BLOCK_SIZE;
+        for (int blk = first; length > 0; ++blk) {
+            int n = std::min(length, BLOCK_SIZE - inBlock);
+            const char* data = ZERO_BLOCK + inBlock;
+            if (!pendingZero(blk)) {
+                if (cache) {
+                    std::lock_guard<std::mutex> guard(cacheLock);
+                    std::memcpy(copy, blockPtr(blk, false) + inBlock, n);
+                    data = copy;
+                } else {
+                    data = base + static_cast<size_t>(blk) * BLOCK_SIZE + inBlock;
+                }
+            }
+            fn(data, n);
+            length -= n;
+            inBlock = 0;
+        }
+        return true;
+    }
+
+    bool isAllocated(int idx) const;  // 块是否已被占用（含只被快照引用的块）
+    int freeBlockCount() const;       // 当前空闲块数量
+
+    // 写时复制快照的块引用计数。被快照引用的块在当前文件系统释放后并不回到空闲位图，
+    // 只记为“由快照保留”，最后一个引用它的快照删除时才真正释放。
+    // 镜像和日志中的位图只记录当前文件系统使用的块，因此重新加载后快照保留的块都是空闲的。
+    // share/unshare/adopt 须在没有其他线程修改磁盘时调用
+    void shareBlock(int idx);         // 快照增加一次引用
+    void unshareBlock(int idx);       // 快照减少一次引用，不再被引用且已由快照保留的块随即释放
+    void adoptBlock(int idx);         // 回滚时当前文件系统重新使用快照保留的块
+    bool isShared(int idx) const;     // 块被快照引用，当前文件系统须复制后才能写入
+    bool hasShared() const;           // 是否有块被快照引用
+    bool isLive(int idx) const;       // 块被当前文件系统使用（已占用且不是只由快照保留）
 
 private:
-    char disk[BLOCK_COUNT][BLOCK_SIZE];     // 虚拟磁盘内存
-    bool blockBitmap[BLOCK_COUNT];          // 块使用位图
+    static constexpr int WORD_BITS = 64;
+
+    int blockCount;
+    int wordCount;
+    std::vector<char> disk;                 // 内存模式下的虚拟磁盘，blockCount * BLOCK_SIZE 字节
+    char* base;                             // 当前块数据起始地址（disk 或映射区）
+
+    // mmap/缓存模式下打开的镜像文件，布局与 saveDisk 相同：块数据后接每块一字节的位图
+    int imageFd;
+    std::string imagePath;
+    char* mapBase;
+    size_t mapLength;
+    std::unique_ptr<BlockCache> cache;
+    std::string savedPath;                  // 内存模式下除脏块外与内存内容一致的镜像文件
+
+    std::vector<uint64_t> dirtyWords;       // 脏块位图，每位一个块
+    int bitmapDirtyLo, bitmapDirtyHi;       // 位图字节的脏区间 [lo, hi)
+    std::vector<uint64_t> changedWords;     // 日志尚未记录的块，每位一个块
+    int bitmapChangedLo, bitmapChangedHi;   // 日志尚未记录的位图字节区间
+    std::vector<uint64_t> zeroWords;        // 已分配但尚未清零的块，读取时视为全 0
+    bool eraseOnFree;
+    static const char ZERO_BLOCK[BLOCK_SIZE];
+    std::vector<uint16_t> shareRefs;        // 每块被快照引用的次数，第一次建立快照时才分配
+    std::vector<uint64_t> heldWords;        // 已分配但只由快照保留的块，每位一个块
+    int sharedBlocks;                       // shareRefs 中非 0 的块数
+
+    // 两级空闲位图：freeWords 中每一位对应一个块（1 表示空闲），
+    // summary 中每一位对应 freeWords 的一个字（1 表示该字中仍有空闲块）。
+    std::vector<uint64_t> freeWords;
+    std::vector<uint64_t> summary;
+    std::atomic<int> freeCount;
+
+    // 分配器分片：第 i 片管理 freeWords 中 [i * shardWords, (i + 1) * shardWords) 的字，
+    // shardWords 是 WORD_BITS 的整数倍，因此每个 summary 字也只属于一片
+    struct AllocShard {
+        std::mutex lock;
+        int hintWord = 0;                   // 片内 next-fit 起始字
+    };
+    static constexpr int MAX_ALLOC_SHARDS = 16;
+    std::unique_ptr<AllocShard[]> shards;
+    int shardCount;
+    int shardWords;
+    std::mutex cacheLock;                   // 缓存模式下保护 BlockCache
+
+    void resetBitmap();
+    void markUsed(int idx);
+    void markFree(int idx);
+    void markUsedRange(int start, int count);
+    void markFreeRange(int start, int count);
+    void markDirty(int start, int count);
+    void holdBlock(int idx);                // 当前文件系统不再使用、但快照仍引用的块
+    static void setBits(std::vector<uint64_t>& words, int start, int count);   // 原子置位 [start, start + count)
+    bool pendingZero(int idx) const;
+    bool anyPendingZero(int start, int end) const;    // [start, end) 中是否有待清零的块
+    void preparePartialWrite(int start, int offset, int length); // 写入前补清零被部分覆盖的待清零块
+    void clearDirty();
+    void setBitmapBytes(int start, int count, char value); // 记录位图字节改动，mmap 模式下同时写入映射区
+    bool writeDirtyBitmap(int fd) const;    // 把位图的脏区间写入镜像文件
+    bool openImage(const std::string& filename, int& blockCount, size_t& length);
+    void releaseImage();
+    char* blockPtr(int idx, bool forWrite);
+    void zeroBlocks(int start, int count);
+    // 以下查找都限制在 [from, limit) 内，不回绕，也不读取范围外其他分片的位图
+    void setSummaryBit(int w, bool hasFree);         // 调用方持有该字所在分片的锁
+    bool shardHasFree(int shard) const;     // 不加锁粗查本片的 summary，结果可能稍有滞后
+    int findFreeWord(int fromWord, int limitWord) const; // 借助 summary 找到下一个含空闲块的字，没有则返回 -1
+    int nextFreeBlock(int from, int limit) const;        // 第一个空闲块，没有则返回 -1
+    int nextUsedBlock(int from, int limit) const;        // 第一个已占用块，没有则返回 limit
+    int findExtent(int count, int from, int lo, int hi) const; // [lo, hi) 内从 from 起回绕查找 count 个连续空闲块
+    int homeShard() const;                  // 当前线程优先分配的分片
+    int shardOf(int idx) const;
+    int shardEndWord(int shard) const;
+    bool validRange(int start, int offset, int length) const;
+
+    template <typename Fn>
+    void forEachRun(const std::vector<uint64_t>& words, Fn fn) const {
+        int idx = 0;
+        while (idx < blockCount) {
+            int w = idx / WORD_BITS;
+            uint64_t bits = words[w] & (~0ULL << (idx % WORD_BITS));
+            if (!bits) {
+                idx = (w + 1) * WORD_BITS;
+                continue;
+            }
+            int start = w * WORD_BITS + __builtin_ctzll(bits);
+            int end = start;
+            while (end < blockCount && (words[end / WORD_BITS] >> (end % WORD_BITS) & 1ULL)) ++end;
+            fn(start, end - start);
+            idx = end;
+        }
+    }
 };
 
 #endif // DISK_H
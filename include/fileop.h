@@ -1,19 +1,60 @@
 #pragma once
 
 #include "fs.h"
+#include <deque>
+#include <functional>
 #include <string>
-#include <vector>
+#include <string_view>
+#include <unordered_map>
+#include <iostream>
 
 class FileOp {
 public:
+    static constexpr size_t MAX_TOKENS = 8;
+
+    // 一行命令切分后的各项，均指向原始输入行，不复制；超过 MAX_TOKENS 的部分被忽略
+    struct Args {
+        std::string_view tokens[MAX_TOKENS];
+        size_t count = 0;
+
+        std::string_view operator[](size_t i) const { return tokens[i]; }
+        size_t size() const { return count; }
+    };
+
+    using Handler = std::function<void(const Args& args)>;
+
+    struct Command {
+        std::string name;
+        size_t minArgs;          // 含命令名在内至少需要的项数
+        std::string usage;
+        std::string help;
+        Handler run;
+    };
+
     explicit FileOp(FileSystemContext& fsCtx);
+    FileOp(const FileOp&) = delete;              // 内置命令的处理函数捕获了 this
+    FileOp& operator=(const FileOp&) = delete;
 
     void run();                              // 启动命令行 REPL
-    void executeCommand(const std::string& line); // 处理单行命令
+    // 批处理：逐行执行 in 中的命令，不打印提示符；空白行和 # 开头的行被忽略，遇到 exit 或输入结束时停止。
+    // 每 BATCH_COMMANDS 条命令合并为一个日志批次，结束时把各类命令的次数与耗时写到 report
+    void runBatch(std::istream& in, std::ostream& report = std::cerr);
+    void executeCommand(std::string_view line); // 处理单行命令
+
+    // 注册命令，同名时替换原来的处理函数；help 按注册顺序列出
+    void registerCommand(std::string_view name, size_t minArgs, std::string_view usage,
+                         std::string_view help, Handler handler);
+    const Command* findCommand(std::string_view name) const;   // 未注册时返回 nullptr
+    static void tokenize(std::string_view line, Args& args);   // 按空白（空格、制表符、\r 等）切分，不分配内存
 
 private:
+    static constexpr int BATCH_COMMANDS = 1024;
+
     FileSystemContext& fs;
+    std::deque<Command> commands;            // 注册顺序；deque 追加时不移动已有元素，表中的键一直有效
+    std::unordered_map<std::string_view, Command*> table;   // 键指向 Command::name
 
+    void registerBuiltins();
     void printHelp() const;
-    std::vector<std::string> split(const std::string& str, char delim) const;
+    void printUsage(std::string_view name) const;   // 缺少操作数时打印该命令的用法
 };
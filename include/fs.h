@@ -4,40 +4,223 @@
 #include "directory.h"
 #include "inode_manager.h"
 #include "disk.h"
+#include "journal.h"
 #include <string>
 #include <sstream>
+#include <string_view>
 #include <iostream>
 #include <unordered_map>
+#include <map>
+#include <vector>
 #include <memory>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
 
+class Session;
+
+// 线程安全：多个线程可以同时调用除 pwd 以外的操作。路径可以是绝对路径，也可以相对于工作目录；
+// 这里的工作目录由所有线程共享，cd 会短暂阻塞其他操作。需要各自独立工作目录的客户端使用 Session。
+// 加锁顺序（从外到内）：
+//   批次闸门 -> 目录树锁 -> 目录锁（逐级向下；同时锁多个目录时按 inode 号从小到大）-> inode 锁
+//   -> InodeManager/DiskManager/日志/路径缓存内部的锁
 class FileSystemContext {
 public:
-    FileSystemContext();
+    explicit FileSystemContext(int blockCount = DiskManager::DEFAULT_BLOCK_COUNT);
 
     void mkdir(const std::string& path);
     void ls(const std::string& path = "");
     void cd(const std::string& path);
-    std::string pwd();
+    const std::string& pwd() const;                   // 只应由调用 cd 的线程使用
+
+    void createFile(const std::string& path, const std::string& content);
+    void readFile(const std::string& path, std::ostream& out = std::cout);
+    // 按块把文件的原始内容依次交给 sink，不在内存中拼出整个文件；读取期间持有文件的读锁，
+    // sink 中不要再调用本对象的操作
+    using ChunkSink = std::function<void(const char* data, int length)>;
+    void streamFile(const std::string& path, const ChunkSink& sink);
 
-    void createFile(const std::string& name, const std::string& content);
-    void readFile(const std::string& name);
+    void rm(const std::string& path);                 // 删除文件
+    void rmdir(const std::string& path);              // 删除目录（空目录）
+    // 删除目录连同其下的一切（rm -r）；子树中有工作目录或打开的文件时拒绝，什么也不删。path 为文件时同 rm
+    void removeTree(const std::string& path);
+    // 复制文件或整棵目录树（cp -r）；dst 为已有目录时复制到其中，否则作为新名字。不能复制到自身子树中
+    void copy(const std::string& src, const std::string& dst);
+    // 目录树用量（du）：文件内容字节数、数据块数、文件数和目录数（含 path 本身）
+    struct Usage {
+        uint64_t bytes = 0;
+        uint64_t blocks = 0;
+        int files = 0;
+        int dirs = 0;
+    };
+    Usage du(const std::string& path = "");
+    void mv(const std::string& src, const std::string& dst); // 移动或重命名文件/目录
+    void appendFile(const std::string& path, const std::string& content);
+    void overwriteFile(const std::string& path, const std::string& content);
+    void truncate(const std::string& path, int size); // 调整文件长度：缩短时释放多余块，加长部分为 0
 
-    void rm(const std::string& name);                 // 删除文件
-    void rmdir(const std::string& name);              // 删除目录（空目录）
-    void appendFile(const std::string& name, const std::string& content);
-    void overwriteFile(const std::string& name, const std::string& content);
+    // 批量导入：把宿主目录 hostDir 下的整棵树复制到虚拟目录 path 下（不存在时创建）。
+    // 文件内容按原始字节复制，不加结束符；已有的同名文件被跳过。宿主文件由后台线程预读，
+    // 与写入虚拟磁盘同时进行；每个文件的块一次预留，每组文件的 inode 一次分配并合并为一个日志批次
+    void importTree(const std::string& hostDir, const std::string& path);
+    // 批量导出：把虚拟目录 path 下的整棵树按原始字节写到宿主目录 hostDir 下（不存在时创建）
+    void exportTree(const std::string& path, const std::string& hostDir);
 
     void save(const std::string& filename);     // 保存虚拟磁盘到文件
     void load(const std::string& filename);           // 从文件加载虚拟磁盘
+    // 直接打开镜像文件，块按需调入：cacheBlocks 为 0 时使用 mmap，否则使用该容量的写回缓存
+    void mount(const std::string& filename, int cacheBlocks = 0);
+
+    // 组提交：begin/endBatch 之间的修改合并为一个日志批次，只落盘一次；可以嵌套。
+    // 多个线程同时修改时，最后一个结束的操作把这期间所有线程的修改一并提交
+    void beginBatch();
+    void endBatch();
+    const Journal& getJournal() const;
+
+    // 安全擦除：删除或截短文件时立即清零释放的块（默认只在重新分配后按需清零）
+    void setSecureErase(bool on);
+
+    // 写时复制快照：snapshot 记下当前的 inode 表和目录树，给其中用到的块各加一次引用，不复制块数据；
+    // 此后第一次写入被共享的块时才复制该块。rollback 把整个文件系统换回快照时的状态（快照保留），
+    // 工作目录回到根目录，打开的文件全部失效。快照只在内存中，load/mount 时全部丢弃
+    void snapshot(const std::string& name);
+    void rollback(const std::string& name);
+    void deleteSnapshot(const std::string& name);
+    std::vector<std::string> listSnapshots();
 
 private:
+    friend class Session;
+
+    // 工作目录：只在 generation 与 treeGeneration 相同时有效，加载了新的目录树后回到根目录
+    struct WorkDir {
+        Directory* dir = nullptr;
+        uint64_t generation = 0;
+    };
+
+    // 会话打开的文件：固定住的 inode 与读写位置。打开期间文件不能被删除，块映射在打开时已展开，
+    // 经描述符读写不再解析路径或查找 inode
+    struct OpenFile {
+        Inode* inode = nullptr;     // 为空表示描述符空闲
+        int offset = 0;
+        uint64_t generation = 0;    // 打开时的目录树代号，加载新镜像后描述符失效
+    };
+
     std::unique_ptr<Directory> root;
-    Directory* current;
+    WorkDir current;           // 直接调用本类操作时使用的工作目录
+    uint64_t treeGeneration;   // 每次换上新的目录树时加一
     InodeManager inodeManager;
     DiskManager diskManager;
 
-    Directory* traverse(const std::string& path, bool createMissing = false);
-    std::vector<std::string> splitPath(const std::string& path);
+    // 预写日志：每个修改操作结束时提交一个批次，save 时作为检查点清空
+    static constexpr uint64_t JOURNAL_CHECKPOINT_BYTES = 4 << 20;  // 日志超过该大小时自动做检查点
+    static constexpr int IMPORT_GROUP_FILES = 256;                 // 导入时每个日志批次至多包含的文件数
+    static constexpr uint64_t IMPORT_GROUP_BYTES = 4 << 20;        // 以及字节数
+    Journal journal;
+    std::string imageName;     // 日志所对应的镜像文件，尚未关联时为空
+    int batchDepth;            // 所有线程进行中的修改操作数（含嵌套）
+    std::vector<char> journalScratch;
+    bool namespaceDirty;       // 上次检查点以来目录树是否有变化
+
+    // 快照：当时的 inode 表和目录树，格式同元数据文件中的对应段。由独占批次和目录树独占锁保护
+    struct Snapshot {
+        std::vector<char> inodes;
+        int nextInodeId = 1;
+        std::vector<char> dirs;
+        std::vector<char> entries;
+        std::string strings;
+    };
+    std::map<std::string, Snapshot> snapshots;
+
+    // 修改操作的作用域：构造时进入批次，析构时退出并在最外层提交日志
+    struct Transaction {
+        FileSystemContext& fs;
+        explicit Transaction(FileSystemContext& ctx) : fs(ctx) { fs.beginBatch(); }
+        ~Transaction() { fs.endBatch(); }
+    };
+
+    // 独占批次：等其他线程进行中的修改操作结束，并在作用域内阻止新的修改操作开始。
+    // 用于检查点和加载；调用线程自己未结束的批次不必等待
+    struct ExclusiveBatch {
+        FileSystemContext& fs;
+        explicit ExclusiveBatch(FileSystemContext& ctx) : fs(ctx) { fs.quiesce(); }
+        ~ExclusiveBatch() { fs.resume(); }
+    };
+
+    // 并发控制用的锁与批次状态，单独分配以便 FileSystemContext 仍可移动（移动时不得有其他线程在使用）
+    static constexpr int MAX_GROUP_OPS = 256;   // 连续这么多操作结束仍未能提交时，新操作等待提交
+    struct Locks {
+        std::shared_mutex tree;      // 目录树结构：普通操作持共享锁；删除/移动目录、cd、加载持独占锁
+        std::shared_mutex dentries;  // 路径缓存
+        std::mutex journal;          // 目录项日志记录
+        std::mutex batch;            // 以下批次状态与 batchDepth
+        std::condition_variable batchIdle;
+        std::unordered_map<std::thread::id, int> owners;  // 各线程的批次嵌套深度
+        int sinceCommit = 0;         // 上次提交以来结束的修改操作数
+        int drainers = 0;            // 在 quiesce 中等待的线程数
+        bool exclusive = false;      // 正在提交日志、做检查点或加载
+        std::mutex files;            // 以下打开计数
+        std::unordered_map<int, int> opened;  // inode -> 被打开的次数
+    };
+    std::unique_ptr<Locks> locks;
+
+    // 路径缓存：起始目录 -> (路径字符串 -> 目标目录)。只缓存目录，
+    // 删除目录或重新加载时整体失效；删除文件不影响其中的项
+    static constexpr size_t DENTRY_CACHE_LIMIT = 4096;
+    std::unordered_map<Directory*, std::unordered_map<std::string, Directory*>> dentryCache;
+    size_t dentryCacheSize;
+
+    // 各操作的实现，相对路径从 wd 开始解析；wd 为 current 或某个会话的工作目录
+    void mkdir(WorkDir& wd, const std::string& path);
+    void ls(WorkDir& wd, const std::string& path);
+    void cd(WorkDir& wd, const std::string& path);
+    std::string pwd(WorkDir& wd);
+    void createFile(WorkDir& wd, const std::string& path, const std::string& content);
+    void readFile(WorkDir& wd, const std::string& path, std::ostream& out);
+    void streamFile(WorkDir& wd, const std::string& path, const ChunkSink& sink);
+    void rm(WorkDir& wd, const std::string& path);
+    void rmdir(WorkDir& wd, const std::string& path);
+    void removeTree(WorkDir& wd, const std::string& path);
+    void copy(WorkDir& wd, const std::string& src, const std::string& dst);
+    Usage du(WorkDir& wd, const std::string& path);
+    void mv(WorkDir& wd, const std::string& src, const std::string& dst);
+    void appendFile(WorkDir& wd, const std::string& path, const std::string& content);
+    void overwriteFile(WorkDir& wd, const std::string& path, const std::string& content);
+    void truncate(WorkDir& wd, const std::string& path, int size);
+    void importTree(WorkDir& wd, const std::string& hostDir, const std::string& path);
+    void exportTree(WorkDir& wd, const std::string& path, const std::string& hostDir);
+    bool open(WorkDir& wd, const std::string& path, OpenFile& file);
+    void close(OpenFile& file);
+    int read(OpenFile& file, char* buffer, int length);
+    int write(OpenFile& file, const char* data, int length);
+    void attach(WorkDir& wd);     // 会话创建时进入根目录
+    void detach(WorkDir& wd);     // 会话销毁时离开工作目录
+
+    // 以下私有函数由调用方持有目录树锁
+    Directory* enter(WorkDir& wd);                        // 返回有效的工作目录
+    void setWorkDir(WorkDir& wd, Directory* dir);
+    void resetSessions();         // 调用方独占目录树锁
+    bool isOpen(int inodeId);
+    Directory* traverse(Directory* cwd, const std::string& path, bool createMissing = false);
+    void invalidateDentries();    // 调用方独占目录树锁或路径缓存锁
+    Directory* resolveParent(Directory* cwd, const std::string& path, std::string& name); // 解析父目录，name 为最后一段
+    bool replaceImage(const std::string& filename, DiskManager& disk, const Journal::Contents& log, bool allowNew);
+    bool recover(const std::string& filename, const Journal::Contents& log, uint64_t appliedSeq);
+    void replayMetadata(const Journal::Contents& log, uint64_t appliedSeq);
+    void recordLink(Directory* parent, const std::string& name, int inodeId, DirEntry::EntryType type);
+    void recordUnlink(Directory* parent, const std::string& name, DirEntry::EntryType type);
+    template <typename Guard>
+    Inode* lockFile(Directory* dir, const std::string& name, Guard& guard);
+    bool moveFile(Directory* cwd, const std::string& src, const std::string& dst);
+    Directory* makeSubdir(Directory* parent, const std::string& name);
+    bool copyFile(Directory* src, const std::string& name, Directory* dst, const std::string& newName, int inodeId);
+    bool moveEntry(Directory* cwd, const std::string& src, const std::string& dst);
+    void collectBlocks(const std::vector<char>& records, std::vector<int>& blocks); // inode 表记录用到的全部块
+    void quiesce();
+    void resume();
+    bool commitJournal();          // 以下两个在独占批次中调用
+    bool checkpoint(const std::string& filename);
 };
 
 #endif // FILESYSTEM_CONTEXT_H
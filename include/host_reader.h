@@ -0,0 +1,57 @@
+#ifndef HOST_READER_H
+#define HOST_READER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+// 导入用的宿主文件读取流水线：后台线程按顺序读出各文件的内容，切成至多 CHUNK_BYTES 字节的块，
+// 经有界队列交给调用线程，读下一块与调用方写入虚拟磁盘同时进行。
+// 缓冲区在 next() 时交还复用，占用内存约为 (QUEUE_CHUNKS + 1) * CHUNK_BYTES，与文件大小和个数无关
+class HostReader {
+public:
+    static constexpr size_t CHUNK_BYTES = 1 << 20;
+    static constexpr size_t QUEUE_CHUNKS = 8;
+
+    struct Chunk {
+        size_t file = 0;           // 文件在 paths 中的下标
+        uint64_t offset = 0;       // 本块在文件中的偏移
+        std::vector<char> data;
+        bool last = false;         // 该文件的最后一块；空文件只有这一块且 data 为空
+        bool failed = false;       // 打开或读取失败、文件比 sizes 中记录的短；之后不再有该文件的块
+    };
+
+    // sizes[i] 为 paths[i] 预期的长度，文件变长时多出的部分不读
+    HostReader(std::vector<std::string> paths, std::vector<uint64_t> sizes);
+    ~HostReader();                 // 停止并等待后台线程
+
+    HostReader(const HostReader&) = delete;
+    HostReader& operator=(const HostReader&) = delete;
+
+    // 取下一块，同时交还 chunk 原来持有的缓冲区；全部读完或已停止时返回 false
+    bool next(Chunk& chunk);
+    void stop();                   // 不再读后续文件，next() 随即返回 false
+
+private:
+    std::vector<std::string> paths;
+    std::vector<uint64_t> sizes;
+
+    std::mutex lock;               // 保护以下队列与状态
+    std::condition_variable changed;
+    std::deque<Chunk> ready;
+    std::vector<std::vector<char>> spare;
+    bool finished = false;         // 后台线程已读完全部文件
+    bool stopped = false;
+    std::thread worker;
+
+    void run();
+    bool push(Chunk&& chunk);      // 队列满时等待；已停止时返回 false
+    std::vector<char> takeBuffer();
+};
+
+#endif // HOST_READER_H
@@ -2,14 +2,26 @@
 #define INODE_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <ctime>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
 
-#include "disk.h" 
+#include "disk.h"
+
+// 一段连续的磁盘块
+struct Extent {
+    int start;   // 起始块
+    int length;  // 块数
+};
 
 class Inode {
 public:
-    static const int DIRECT_BLOCKS = 8; // 直接块数量，可调整
+    static constexpr int DIRECT_BLOCKS = 8; // 直接块数量，可调整
+    static constexpr int PTRS_PER_BLOCK = DiskManager::BLOCK_SIZE / sizeof(int32_t); // 每个间接块可存的块号数
+    static constexpr int MAX_BLOCKS = DIRECT_BLOCKS + PTRS_PER_BLOCK + PTRS_PER_BLOCK * PTRS_PER_BLOCK;
 
     enum FileType {
         FILE,
@@ -21,18 +33,98 @@ public:
     int inodeId;                  // i-node编号
     FileType type;               // 文件类型
     int size;                    // 文件大小（字节）
-    int blockCount;              // 实际使用的块数
+    int blockCount;              // 实际使用的数据块数
     int directBlocks[DIRECT_BLOCKS]; // 直接块指针
+    int indirectBlock;           // 一级间接块，-1 表示未分配
+    int doubleIndirectBlock;     // 二级间接块，-1 表示未分配
     time_t createTime;           // 创建时间
     time_t modifyTime;           // 修改时间
 
-    void addBlock(int blockIdx);
+    void addBlock(DiskManager& disk, int blockIdx);
+    void addExtent(DiskManager& disk, int start, int length);    // 记录一段连续块
     const int* getBlocks() const;
 
-    // 与磁盘交互的读写接口
+    int blockAt(DiskManager& disk, int index) const;              // 第 index 个数据块的块号
+    const std::vector<int>& getBlockMap(DiskManager& disk) const; // 全部数据块块号（带缓存）
+    bool blockMapCached() const;   // 块映射已展开；未展开时首次访问会修改缓存，多线程读之前须在独占锁下展开
+
+    // 按顺序遍历第 first 到 last-1 个数据块，相邻的块合并为一个 extent，
+    // 连同该 extent 第一个块的逻辑序号交给 fn(ext, index)
+    template <typename Fn>
+    void forEachExtent(DiskManager& disk, int first, int last, Fn fn) const {
+        const std::vector<int>& blocks = getBlockMap(disk);
+        int i = std::max(first, 0);
+        last = std::min(last, blockCount);
+        while (i < last) {
+            Extent ext{blocks[i], 1};
+            while (i + ext.length < last && blocks[i + ext.length] == ext.start + ext.length) {
+                ++ext.length;
+            }
+            fn(ext, i);
+            i += ext.length;
+        }
+    }
+
+    // 按顺序遍历全部数据块的 extent
+    template <typename Fn>
+    void forEachExtent(DiskManager& disk, Fn fn) const {
+        forEachExtent(disk, 0, blockCount, [&](const Extent& ext, int) { fn(ext); });
+    }
+
+    // 按偏移读写：只访问涉及的块。read 返回实际读取的字节数（不超过文件末尾），
+    // write 在需要时扩展文件，返回写入的字节数，失败返回 -1
+    int read(DiskManager& disk, int offset, int length, char* buffer) const;
+    int write(DiskManager& disk, int offset, int length, const char* data);
+    int write(DiskManager& disk, int offset, std::string_view data);
+
+    // 流式读取：把 [offset, offset + length) 中文件内的部分按 extent 依次交给 fn(data, n)，
+    // 内存和 mmap 模式下不经过中间缓冲区，占用内存与文件大小无关。返回交出的字节数
+    template <typename Fn>
+    int readStream(DiskManager& disk, int offset, int length, Fn fn) const {
+        if (offset < 0 || length <= 0 || offset >= size) return 0;
+        int end = length > size - offset ? size : offset + length;
+        const int bs = DiskManager::BLOCK_SIZE;
+        int done = 0;
+        forEachExtent(disk, offset / bs, (end - 1) / bs + 1, [&](const Extent& ext, int index) {
+            int from = std::max(offset, index * bs);
+            int to = std::min(end, (index + ext.length) * bs);
+            disk.visitBlocks(ext.start, from - index * bs, to - from, fn);
+            done += to - from;
+        });
+        return done;
+    }
+    bool truncate(DiskManager& disk, int newSize);   // 调整文件大小，缩短时释放多余块
+
+    // 与磁盘交互的读写接口。writeData 把内容整体替换为 data：原有的块原地改写，
+    // 只为长度差分配或释放块；失败时文件被清空
     bool writeData(DiskManager& disk, const char* data, int length);
+    bool writeData(DiskManager& disk, std::string_view data);
     bool readData(DiskManager& disk, char* buffer, int maxLength) const;
     void clearData(DiskManager& disk);
+
+    // 写时复制：把第 first 到 last-1 个数据块中被快照共享的块（连同需要改写的间接块）
+    // 换成当前文件系统独占的副本，之后才能原地写入。磁盘已满时返回 false
+    bool unshareBlocks(DiskManager& disk, int first, int last);
+    void collectBlocks(DiskManager& disk, std::vector<int>& out) const;   // 追加全部数据块和间接块的块号
+
+    // 版本 2 元数据中的定长记录，见 metadata.h
+    static constexpr int RECORD_SIZE = 80;
+    void encode(char* rec) const;
+    void decode(const char* rec);
+
+    void deserialize(std::istream& in);   // 旧版流式格式，仅用于读取旧的元数据文件
+
+private:
+    // 块映射缓存：展开后的全部数据块号，避免每次按偏移查找时重新读取间接块
+    mutable std::vector<int> blockMapCache;
+    mutable bool blockMapValid;
+
+    int allocatePointerBlock(DiskManager& disk);
+    bool ownBlock(DiskManager& disk, int& blk);          // blk 被快照共享时换成副本
+    void ownPointerBlock(DiskManager& disk, int& blk);   // 同上，失败时抛出异常
+    bool setBlock(DiskManager& disk, int index, int blk); // 改写第 index 个数据块的块号
+    bool growBlocks(DiskManager& disk, int newCount, int hint); // 追加数据块直到 newCount 个
+    void shrinkBlocks(DiskManager& disk, int newCount);         // 释放第 newCount 个之后的数据块及多余的间接块
 };
 
 #endif // INODE_H
@@ -2,23 +2,95 @@
 #define INODE_MANAGER_H
 
 #include "inode.h"
-#include <unordered_map>
+#include <memory>
+#include <shared_mutex>
+#include <vector>
 
+// inode 表：按 inodeId 直接下标访问的稠密数组。
+// 表按固定大小的块（chunk）增长，已分配的块不会移动，因此 Inode* 在表增长后仍然有效；
+// 释放的 id 通过槽位内的 nextFree 串成空闲链表，分配时优先复用。
+//
+// 线程安全：分配、释放、查找和 markChanged 可以并发调用（表本身由一把读写锁保护）；
+// 每个槽位另有一把读写锁，由调用方在读写 inode 内容时持有，见 inodeLock()。
+// 表的装载、打包以及 forEachChanged/clear* 须在没有其他线程修改时调用
 class InodeManager {
 public:
     InodeManager();
 
+    // 移动时不转移锁，调用方须保证没有其他线程在使用两个对象
+    InodeManager(InodeManager&& other) noexcept;
+    InodeManager& operator=(InodeManager&& other) noexcept;
+
     int allocateInode(Inode::FileType type);
+    // 一次取得表锁连续分配 count 个 inode，id 追加到 ids 末尾；用于批量导入
+    void allocateInodes(Inode::FileType type, int count, std::vector<int>& ids);
     Inode* getInode(int inodeId);
     void deleteInode(int inodeId);
+    void deleteInodes(const std::vector<int>& ids);   // 一次取得表锁释放多个 inode
+
+    // inode 的读写锁：读文件持共享锁，修改持独占锁。锁属于槽位，inode 释放后仍然有效
+    std::shared_mutex& inodeLock(int inodeId);
     
-    void serialize(std::ostream& out);
-    void deserialize(std::istream& in);
+    // 元数据中的 inode 表：第 id 个定长记录对应 inode id，空闲槽位全为 0。
+    // unpackTable 依次读取 count 个记录，跳过 id 为 0 的记录，因此也能读取按顺序紧排的旧表
+    void packTable(std::vector<char>& out, int capacity) const;
+    void unpackTable(const char* records, size_t count, int nextId);
+    void encodeSlot(int inodeId, char* record) const;   // 空闲槽位编码为全 0
+    int highWater() const;    // 从未使用过的最小 id
+
+    void deserialize(std::istream& in);   // 旧版流式格式
+
+    int inodeCount() const;   // 当前在用的 inode 数
+
+    // 分配、释放或经 markChanged() 标记过的 inode 同时记入两个集合：
+    // “已改动”集合供预写日志记录，提交后 clearChanges()；
+    // “脏”集合供检查点按槽位写回元数据文件，检查点后 clearDirty()。
+    // forEachChanged 的 fn(id, node) 中 node 为 nullptr 表示该 inode 已被释放
+    void markChanged(int inodeId);
+    template <typename Fn>
+    void forEachChanged(Fn fn) const {
+        for (int id : changedIds) {
+            const Slot& slot = slotAt(id);
+            fn(id, slot.nextFree == LIVE ? &slot.node : nullptr);
+        }
+    }
+    void clearChanges();
+    const std::vector<int>& dirtySlots() const;
+    void clearDirty();
 
+    // 日志回放：按定长记录恢复单个 inode（必要时抬高高水位），全部回放后调用 rebuildFreeList()
+    void restoreInode(const char* record);
+    void rebuildFreeList();
 
 private:
-    int nextInodeId;
-    std::unordered_map<int, Inode> inodeTable;
+    static constexpr int CHUNK_SHIFT = 8;
+    static constexpr int CHUNK_SIZE = 1 << CHUNK_SHIFT;   // 每块 256 个槽位
+    static constexpr int LIVE = -2;                      // nextFree 取此值表示槽位在用
+
+    struct Slot {
+        Inode node;
+        int nextFree = -1;    // 空闲链表中的下一个 id，-1 为链尾
+        uint8_t pending = 0;  // IN_CHANGED / IN_DIRTY：已在对应的 id 列表中
+        std::shared_mutex lock;
+    };
+
+    static constexpr uint8_t IN_CHANGED = 1;
+    static constexpr uint8_t IN_DIRTY = 2;
+
+    std::vector<std::unique_ptr<Slot[]>> chunks;
+    int nextInodeId;   // 从未使用过的最小 id（高水位）
+    int freeHead;      // 空闲链表表头，-1 表示为空
+    int liveCount;
+    std::vector<int> changedIds;
+    std::vector<int> dirtyIds;
+    mutable std::shared_mutex tableLock;   // 保护 chunks 的增长、空闲链表和两个 id 列表
+
+    Slot& slotAt(int inodeId);
+    const Slot& slotAt(int inodeId) const;
+    void ensureCapacity(int inodeId);
+    int takeSlot(Inode::FileType type);          // 分配一个槽位，调用方持有 tableLock
+    void releaseSlot(int inodeId);               // 释放一个槽位，调用方持有 tableLock
+    void noteChanged(Slot& slot, int inodeId);   // 记入两个 id 列表，调用方持有 tableLock
 };
 
 
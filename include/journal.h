@@ -0,0 +1,101 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "inode.h"
+#include "directory.h"
+
+// 预写重做日志（redo log）。
+// 改动先以记录的形式追加到内存中的待提交缓冲区，commit() 把它们作为一个批次
+// 一次 write 追加到日志文件末尾并 fdatasync 一次（组提交）。每个批次带序号和校验和，
+// 回放时只采用校验通过的完整批次，写到一半的尾部批次被丢弃。
+//
+// 记录分两类：
+//   DISK_WRITE            镜像文件中的一段字节（块数据或位图），按偏移原样重写，可重复回放
+//   INODE / INODE_FREE    inode 的定长记录或释放
+//   LINK / UNLINK         目录项的增删（逻辑记录），按目录的 inode 号定位
+//   TREE                  整棵目录树（快照回滚时换上的树），格式同元数据中的目录段
+class Journal {
+public:
+    enum RecordType : uint32_t {
+        DISK_WRITE = 1,
+        INODE = 2,
+        INODE_FREE = 3,
+        LINK = 4,
+        UNLINK = 5,
+        TREE = 6
+    };
+
+    struct Record {
+        uint64_t seq;        // 所属批次
+        uint32_t type;
+        const char* body;    // 指向 Contents::data 内部
+        uint32_t length;
+    };
+
+    // 日志文件中全部已提交的记录，按写入顺序排列
+    struct Contents {
+        std::vector<char> data;
+        std::vector<Record> records;
+        uint64_t lastSeq = 0;
+    };
+
+    struct Stats {
+        uint64_t commits = 0;    // 提交的批次数（即 fdatasync 次数）
+        uint64_t records = 0;    // 写入的记录数
+        uint64_t bytes = 0;      // 写入日志文件的字节数
+    };
+
+    Journal();
+    ~Journal();
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+    Journal(Journal&& other) noexcept;
+    Journal& operator=(Journal&& other) noexcept;
+
+    // 打开并清空日志文件，此后的批次序号从 lastSeq + 1 开始。
+    // 调用方须保证此前的日志内容都已并入镜像和元数据
+    bool open(const std::string& path, uint64_t lastSeq);
+    void close();
+    bool isOpen() const;
+
+    // 以下记录在日志未打开时直接忽略
+    void logDiskWrite(uint64_t offset, const char* data, size_t length);
+    void logInode(const Inode& node);
+    void logInodeFree(int inodeId);
+    void logLink(int parentInode, const std::string& name, int inodeId, DirEntry::EntryType type);
+    void logUnlink(int parentInode, const std::string& name, DirEntry::EntryType type);
+    void logTree(const std::vector<char>& dirs, const std::vector<char>& entries, const std::string& strings);
+
+    bool hasPending() const;
+    bool commit();                   // 把待提交记录作为一个批次写入并落盘；失败时日志文件恢复原样，记录留待下次重试
+    bool reset();                    // 检查点之后丢弃待提交记录并清空日志文件
+    uint64_t lastSeq() const;        // 最后一个已提交批次的序号
+    uint64_t size() const;           // 日志文件当前字节数
+    const Stats& stats() const;
+
+    // 读取日志文件中的已提交批次；文件不存在时返回空内容
+    static Contents read(const std::string& path);
+    // 把 DISK_WRITE 记录按偏移写入镜像文件并落盘
+    static bool applyToImage(const Contents& contents, const std::string& imagePath);
+
+private:
+    static constexpr uint32_t MAGIC = 0x4C4E524A;   // "JRNL"
+    static constexpr size_t HEADER_SIZE = 32;
+
+    int fd;
+    uint64_t seq;
+    uint64_t fileSize;
+    uint32_t pendingCount;
+    std::vector<char> pending;       // 批次头部预留在最前面
+    Stats counters;
+
+    char* appendRecord(uint32_t type, size_t length);
+};
+
+#endif // JOURNAL_H
@@ -0,0 +1,94 @@
+#ifndef METADATA_H
+#define METADATA_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+class InodeManager;
+class Directory;
+
+// 元数据文件格式（版本 3）。所有整数均为小端定长，与编译器、平台无关：
+//
+//   [超级块 SUPERBLOCK_SIZE 字节]
+//   [inode 表]    inodeCapacity 个 INODE_RECORD_SIZE 字节的槽位，第 id 个槽位存 inode id，空闲槽位全为 0
+//   [目录表]      目录按广度优先顺序排列，父目录总在子目录之前
+//   [目录项表]    文件项，同一目录的项连续存放
+//   [字符串表]    目录名和文件名首尾相接，记录中只存 (偏移, 长度)
+//
+// 各段起始位置按 SECTION_ALIGN 对齐并记录在超级块中。
+// 加载时整个文件一次读入内存，再按定长记录逐段解析，不做逐项的流读取。
+// inode 表按槽位定位，检查点可以只改写脏槽位；版本 2 的 inode 表按顺序紧排，仍可读取。
+namespace metadata {
+
+constexpr char MAGIC[8] = {'F', 'S', 'M', 'E', 'T', 'A', '\0', '\0'};
+constexpr uint32_t VERSION = 3;
+
+constexpr size_t SUPERBLOCK_SIZE = 128;
+constexpr size_t SECTION_ALIGN = 1024;
+constexpr size_t INODE_RECORD_SIZE = 80;
+constexpr size_t DIR_RECORD_SIZE = 32;
+constexpr size_t ENTRY_RECORD_SIZE = 16;
+constexpr uint32_t NO_PARENT = 0xFFFFFFFFu;
+
+inline void putU32(char* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<char>(v >> (8 * i));
+}
+
+inline void putU64(char* p, uint64_t v) {
+    for (int i = 0; i < 8; ++i) p[i] = static_cast<char>(v >> (8 * i));
+}
+
+inline uint32_t getU32(const char* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v |= static_cast<uint32_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    return v;
+}
+
+inline uint64_t getU64(const char* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v |= static_cast<uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    return v;
+}
+
+struct Superblock {
+    uint32_t version = VERSION;
+    uint32_t blockSize = 0;      // 磁盘块大小，加载时校验
+    uint32_t diskBlocks = 0;     // 磁盘块数，加载时校验
+    uint32_t nextInodeId = 1;
+    uint32_t inodeCount = 0;
+    uint32_t dirCount = 0;
+    uint32_t entryCount = 0;
+    uint32_t stringBytes = 0;
+    uint64_t inodeOffset = 0;
+    uint64_t dirOffset = 0;
+    uint64_t entryOffset = 0;
+    uint64_t stringOffset = 0;
+    uint64_t journalSeq = 0;     // 已并入本文件的最后一个日志批次序号
+    uint32_t inodeCapacity = 0;  // inode 表的槽位数，预留了增长空间
+
+    void encode(char* p) const;
+    bool decode(const char* p, size_t length);   // 魔数不符或长度不足时返回 false
+};
+
+// 把 inode 表和目录树完整写入 path：先写临时文件并落盘，再改名替换旧文件。
+// journalSeq 为此时已提交的最后一个日志批次序号
+bool save(const std::string& path, const InodeManager& inodes, const Directory& root,
+          int blockSize, int diskBlocks, uint64_t journalSeq = 0);
+
+// 增量检查点：只按槽位改写脏 inode；root 不为空时表示目录树有变化，新的目录段追加在文件末尾。
+// 数据落盘后才改写超级块，因此中途崩溃时文件仍指向旧的完整目录树，半新的 inode 槽位由日志重做。
+// 文件格式或参数不符、inode 表槽位不够或文件中的空洞过多时返回 false，调用方应改用 save()
+bool update(const std::string& path, const InodeManager& inodes, const Directory* root,
+            int blockSize, int diskBlocks, uint64_t journalSeq);
+
+// 读取 path 中的元数据；没有魔数时按最早的流式格式读取。
+// 文件不存在返回 false，内容损坏或与磁盘参数不符时抛出 std::runtime_error。
+// journalSeq 返回文件中记录的日志序号，旧格式为 0
+bool load(const std::string& path, InodeManager& inodes, std::unique_ptr<Directory>& root,
+          int blockSize, int diskBlocks, uint64_t& journalSeq);
+
+} // namespace metadata
+
+#endif // METADATA_H
@@ -0,0 +1,126 @@
+#ifndef NAME_INDEX_H
+#define NAME_INDEX_H
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+// 目录项名字的开放寻址哈希索引（线性探测）。
+// 索引只保存名字的哈希值和其在目录项数组中的下标，不保存名字本身；
+// 比较名字时通过调用方提供的 nameOf(slot) 取回，因此数组扩容不会使索引失效；元素换位时用 relocate() 更新。
+class NameIndex {
+public:
+    NameIndex() : used(0), tombstones(0) {}
+
+    // 返回名字对应的下标，不存在时返回 -1
+    template <typename NameOf>
+    int find(std::string_view name, NameOf nameOf) const {
+        size_t i;
+        return locate(name, nameOf, i) ? table[i].slot : -1;
+    }
+
+    // 调用方需保证 name 尚未在索引中
+    void insert(std::string_view name, int slot) {
+        if ((used + tombstones + 1) * 4 >= table.size() * 3) grow();
+        place(hashOf(name), slot);
+        ++used;
+    }
+
+    template <typename NameOf>
+    bool erase(std::string_view name, NameOf nameOf) {
+        size_t i;
+        if (!locate(name, nameOf, i)) return false;
+        table[i].slot = DELETED;
+        --used;
+        ++tombstones;
+        return true;
+    }
+
+    // 目录项从 oldSlot 移动到 newSlot 后更新索引
+    void relocate(std::string_view name, int oldSlot, int newSlot) {
+        uint32_t h = hashOf(name);
+        size_t mask = table.size() - 1;
+        for (size_t i = h & mask; table[i].slot != EMPTY; i = (i + 1) & mask) {
+            if (table[i].slot == oldSlot) {
+                table[i].slot = newSlot;
+                return;
+            }
+        }
+    }
+
+    void clear() {
+        table.clear();
+        used = 0;
+        tombstones = 0;
+    }
+
+    void reserve(size_t count) {
+        size_t cap = 8;
+        while (cap * 3 <= count * 4) cap <<= 1;
+        if (cap > table.size()) rehash(cap);
+    }
+
+    size_t size() const { return used; }
+
+private:
+    static constexpr int32_t EMPTY = -1;
+    static constexpr int32_t DELETED = -2;
+
+    struct Bucket {
+        uint32_t hash;
+        int32_t slot;
+    };
+
+    std::vector<Bucket> table;   // 容量始终为 2 的幂
+    size_t used;
+    size_t tombstones;
+
+    static uint32_t hashOf(std::string_view name) {
+        size_t h = std::hash<std::string_view>{}(name);
+        return static_cast<uint32_t>(h ^ (h >> 32));
+    }
+
+    template <typename NameOf>
+    bool locate(std::string_view name, NameOf nameOf, size_t& pos) const {
+        if (table.empty()) return false;
+        uint32_t h = hashOf(name);
+        size_t mask = table.size() - 1;
+        for (size_t i = h & mask;; i = (i + 1) & mask) {
+            const Bucket& b = table[i];
+            if (b.slot == EMPTY) return false;
+            if (b.slot != DELETED && b.hash == h && nameOf(b.slot) == name) {
+                pos = i;
+                return true;
+            }
+        }
+    }
+
+    void place(uint32_t h, int slot) {
+        size_t mask = table.size() - 1;
+        size_t i = h & mask;
+        while (table[i].slot >= 0) i = (i + 1) & mask;
+        if (table[i].slot == DELETED) --tombstones;
+        table[i] = Bucket{h, slot};
+    }
+
+    void grow() {
+        // 墓碑过多时原地重建即可，否则容量翻倍
+        size_t cap = table.empty() ? 8 : table.size();
+        if ((used + 1) * 2 >= cap) cap <<= 1;
+        rehash(cap);
+    }
+
+    void rehash(size_t cap) {
+        std::vector<Bucket> old;
+        old.swap(table);
+        table.assign(cap, Bucket{0, EMPTY});
+        tombstones = 0;
+        for (const Bucket& b : old) {
+            if (b.slot >= 0) place(b.hash, b.slot);
+        }
+    }
+};
+
+#endif // NAME_INDEX_H
@@ -0,0 +1,59 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "fs.h"
+#include <string>
+#include <iostream>
+#include <vector>
+
+// 会话：共享同一个 FileSystemContext 的轻量客户端句柄，各自持有工作目录和打开文件表。
+// 一个会话同一时间只应由一个线程使用；不同会话可以在各自的线程中并发操作，
+// 各自的 cd 互不影响，也不需要独占目录树。会话不能比所属的 FileSystemContext 活得久。
+// 加载新的镜像后，各会话的工作目录回到根目录
+class Session {
+public:
+    explicit Session(FileSystemContext& fs);   // 工作目录为根目录
+    ~Session();
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    void mkdir(const std::string& path);
+    void ls(const std::string& path = "");
+    void cd(const std::string& path);
+    std::string pwd();
+
+    void createFile(const std::string& path, const std::string& content);
+    void readFile(const std::string& path, std::ostream& out = std::cout);
+    void streamFile(const std::string& path, const FileSystemContext::ChunkSink& sink);
+
+    void rm(const std::string& path);
+    void rmdir(const std::string& path);
+    void removeTree(const std::string& path);
+    void copy(const std::string& src, const std::string& dst);
+    FileSystemContext::Usage du(const std::string& path = "");
+    void mv(const std::string& src, const std::string& dst);
+    void appendFile(const std::string& path, const std::string& content);
+    void overwriteFile(const std::string& path, const std::string& content);
+    void truncate(const std::string& path, int size);
+    void importTree(const std::string& hostDir, const std::string& path);
+    void exportTree(const std::string& path, const std::string& hostDir);
+
+    // 文件描述符：open 返回非负整数，失败返回 -1。read/write 从当前位置开始按字节读写并推进位置，
+    // 返回实际读写的字节数（读到文件末尾为 0），失败返回 -1。文件打开期间不能被删除
+    int open(const std::string& path);
+    int read(int fd, char* buffer, int length);
+    int write(int fd, const char* data, int length);
+    int seek(int fd, int offset);        // 设置读写位置，返回新位置，失败返回 -1
+    bool close(int fd);
+
+private:
+    FileSystemContext& fs;
+    FileSystemContext::WorkDir wd;
+    std::vector<FileSystemContext::OpenFile> files;   // 下标即描述符
+    std::vector<int> freeFds;                         // 关闭后可复用的描述符
+
+    FileSystemContext::OpenFile* lookup(int fd, const char* op);
+};
+
+#endif // SESSION_H
@@ -0,0 +1,108 @@
+#include "block_cache.h"
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+
+BlockCache::BlockCache(int fd, int blockSize, int capacity)
+    : fd(fd), blockSize(blockSize), head(-1), tail(-1), used(0), evictFailed(false) {
+    if (capacity < 1) capacity = 1;
+    data.assign(static_cast<size_t>(capacity) * blockSize, 0);
+    frames.assign(capacity, Frame{-1, false, -1, -1});
+    index.reserve(capacity);
+}
+
+char* BlockCache::frameData(int f) {
+    return data.data() + static_cast<size_t>(f) * blockSize;
+}
+
+void BlockCache::unlink(int f) {
+    Frame& fr = frames[f];
+    if (fr.prev != -1) frames[fr.prev].next = fr.next; else head = fr.next;
+    if (fr.next != -1) frames[fr.next].prev = fr.prev; else tail = fr.prev;
+    fr.prev = fr.next = -1;
+}
+
+void BlockCache::pushFront(int f) {
+    frames[f].prev = -1;
+    frames[f].next = head;
+    if (head != -1) frames[head].prev = f;
+    head = f;
+    if (tail == -1) tail = f;
+}
+
+bool BlockCache::writeBack(int f) {
+    Frame& fr = frames[f];
+    off_t offset = static_cast<off_t>(fr.block) * blockSize;
+    if (::pwrite(fd, frameData(f), blockSize, offset) != static_cast<ssize_t>(blockSize)) return false;
+    fr.dirty = false;
+    ++counters.writebacks;
+    return true;
+}
+
+char* BlockCache::get(int blockIdx, bool forWrite) {
+    auto it = index.find(blockIdx);
+    int f;
+    if (it != index.end()) {
+        f = it->second;
+        ++counters.hits;
+        if (f != head) {
+            unlink(f);
+            pushFront(f);
+        }
+    } else {
+        ++counters.misses;
+        if (used < static_cast<int>(frames.size())) {
+            f = used++;
+        } else {
+            // 淘汰最久未使用的帧，脏帧先写回
+            f = tail;
+            unlink(f);
+            if (frames[f].dirty && !writeBack(f)) evictFailed = true;   // 帧仍要复用，内容已丢失
+            index.erase(frames[f].block);
+            ++counters.evictions;
+        }
+        frames[f].block = blockIdx;
+        frames[f].dirty = false;
+        off_t offset = static_cast<off_t>(blockIdx) * blockSize;
+        ssize_t n = ::pread(fd, frameData(f), blockSize, offset);
+        if (n < blockSize) {
+            std::memset(frameData(f) + std::max<ssize_t>(n, 0), 0, blockSize - std::max<ssize_t>(n, 0));
+        }
+        index[blockIdx] = f;
+        pushFront(f);
+    }
+    if (forWrite) frames[f].dirty = true;
+    return frameData(f);
+}
+
+bool BlockCache::sync() {
+    std::vector<int> dirty;
+    for (int f = 0; f < used; ++f) {
+        if (frames[f].dirty) dirty.push_back(f);
+    }
+    // 按块号排序，使写回尽量顺序进行
+    std::sort(dirty.begin(), dirty.end(), [&](int a, int b) {
+        return frames[a].block < frames[b].block;
+    });
+    bool ok = !evictFailed;
+    for (int f : dirty) {
+        if (!writeBack(f)) ok = false;   // 写回失败的帧保持为脏
+    }
+    return ok;
+}
+
+int BlockCache::dirtyCount() const {
+    int count = 0;
+    for (int f = 0; f < used; ++f) {
+        if (frames[f].dirty) ++count;
+    }
+    return count;
+}
+
+int BlockCache::capacity() const {
+    return static_cast<int>(frames.size());
+}
+
+const BlockCache::Stats& BlockCache::stats() const {
+    return counters;
+}
@@ -1,85 +1,142 @@
 #include "directory.h"
+#include "metadata.h"
 #include <iostream>
 #include <algorithm>
+#include <stdexcept>
+#include <vector>
 
 Directory::Directory(const std::string& name, int id, Directory* parent)
-    : dirName(name), inodeId(id), parentDir(parent) {}
+    : dirName(name), inodeId(id), parentDir(parent) {
+    refreshPath();
+}
 
-Directory* Directory::addSubdir(const std::string& name, int id) {
-    for (const auto& d : subdirs) {
-        if (d->dirName == name) {
-            std::cerr << "Subdirectory already exists: " << name << std::endl;
-            return nullptr;
+void Directory::refreshPath() {
+    // 显式栈遍历子树，深层目录不会耗尽调用栈
+    std::vector<Directory*> stack{this};
+    while (!stack.empty()) {
+        Directory* dir = stack.back();
+        stack.pop_back();
+        if (dir->parentDir == nullptr) {
+            dir->fullPath = "/"; // 根目录
+        } else {
+            const std::string& parentPath = dir->parentDir->fullPath;
+            dir->fullPath.reserve(parentPath.size() + 1 + dir->dirName.size());
+            dir->fullPath.assign(parentPath);
+            if (parentPath != "/") dir->fullPath += '/';
+            dir->fullPath += dir->dirName;
         }
+        for (auto& sub : dir->subdirs) {
+            stack.push_back(sub.get());
+        }
+    }
+}
+
+int Directory::subdirSlot(std::string_view name) const {
+    return subdirIndex.find(name, [this](int slot) -> std::string_view { return subdirs[slot]->dirName; });
+}
+
+int Directory::fileSlot(std::string_view name) const {
+    return fileIndex.find(name, [this](int slot) -> std::string_view { return files[slot].name; });
+}
+
+Directory* Directory::addSubdir(const std::string& name, int id) {
+    if (subdirSlot(name) != -1) {
+        std::cerr << "Subdirectory already exists: " << name << std::endl;
+        return nullptr;
     }
     subdirs.emplace_back(std::make_unique<Directory>(name, id, this));
+    subdirIndex.insert(name, static_cast<int>(subdirs.size()) - 1);
     return subdirs.back().get();
 }
 
 void Directory::addFile(const std::string& name, int id) {
-    for (const auto& f : files) {
-        if (f.name == name) {
-            std::cerr << "File already exists: " << name << std::endl;
-            return;
-        }
+    if (fileSlot(name) != -1) {
+        std::cerr << "File already exists: " << name << std::endl;
+        return;
     }
     files.emplace_back(name, id, DirEntry::FILE);
+    fileIndex.insert(name, static_cast<int>(files.size()) - 1);
 }
 
-Directory* Directory::findSubdir(const std::string& name) {
-    for (const auto& d : subdirs) {
-        if (d->dirName == name) {
-            return d.get();
-        }
-    }
-    return nullptr;
+Directory* Directory::findSubdir(std::string_view name) {
+    int slot = subdirSlot(name);
+    return slot == -1 ? nullptr : subdirs[slot].get();
 }
 
-int Directory::findFile(const std::string& name) const {
-    for (const auto& f : files) {
-        if (f.name == name) {
-            return f.inodeId;
-        }
-    }
-    return -1;
+int Directory::findFile(std::string_view name) const {
+    int slot = fileSlot(name);
+    return slot == -1 ? -1 : files[slot].inodeId;
 }
 
+// 删除时把最后一项移到空出的位置，避免整体搬移
 void Directory::removeSubdir(const std::string& name) {
-    auto it = std::remove_if(subdirs.begin(), subdirs.end(), [&](const std::unique_ptr<Directory>& d) {
-        return d->dirName == name;
-    });
-    if (it != subdirs.end()) {
-        subdirs.erase(it, subdirs.end());
-    } else {
+    if (!detachSubdir(name)) {
         std::cerr << "Subdirectory not found: " << name << std::endl;
     }
 }
 
+std::unique_ptr<Directory> Directory::detachSubdir(const std::string& name) {
+    int slot = subdirSlot(name);
+    if (slot == -1) return nullptr;
+    subdirIndex.erase(name, [this](int s) -> std::string_view { return subdirs[s]->dirName; });
+    std::unique_ptr<Directory> dir = std::move(subdirs[slot]);
+    int last = static_cast<int>(subdirs.size()) - 1;
+    if (slot != last) {
+        subdirs[slot] = std::move(subdirs[last]);
+        subdirIndex.relocate(subdirs[slot]->dirName, last, slot);
+    }
+    subdirs.pop_back();
+    dir->parentDir = nullptr;
+    return dir;
+}
+
+Directory* Directory::attachSubdir(std::unique_ptr<Directory> dir, const std::string& name) {
+    if (subdirSlot(name) != -1) {
+        std::cerr << "Subdirectory already exists: " << name << std::endl;
+        return nullptr;
+    }
+    dir->dirName = name;
+    dir->parentDir = this;
+    dir->refreshPath();
+    subdirs.push_back(std::move(dir));
+    subdirIndex.insert(name, static_cast<int>(subdirs.size()) - 1);
+    return subdirs.back().get();
+}
+
+bool Directory::isAncestorOf(const Directory* dir) const {
+    for (; dir != nullptr; dir = dir->parentDir) {
+        if (dir == this) return true;
+    }
+    return false;
+}
+
 void Directory::removeFile(const std::string& name) {
-    auto it = std::remove_if(files.begin(), files.end(), [&](const DirEntry& f) {
-        return f.name == name;
-    });
-    if (it != files.end()) {
-        files.erase(it, files.end());
-    } else {
+    int slot = fileSlot(name);
+    if (slot == -1) {
         std::cerr << "File not found: " << name << std::endl;
+        return;
     }
+    fileIndex.erase(name, [this](int s) -> std::string_view { return files[s].name; });
+    int last = static_cast<int>(files.size()) - 1;
+    if (slot != last) {
+        files[slot] = std::move(files[last]);
+        fileIndex.relocate(files[slot].name, last, slot);
+    }
+    files.pop_back();
 }
 
 void Directory::listContents() const {
-    std::cout << "Directory: " << dirName << std::endl;
+    std::cout << "Directory: " << dirName << '\n';
     for (const auto& d : subdirs) {
-        std::cout << "  [DIR]  " << d->dirName << " (inode: " << d->inodeId << ")" << std::endl;
+        std::cout << "  [DIR]  " << d->dirName << " (inode: " << d->inodeId << ")\n";
     }
     for (const auto& f : files) {
-        std::cout << "  [FILE] " << f.name << " (inode: " << f.inodeId << ")" << std::endl;
+        std::cout << "  [FILE] " << f.name << " (inode: " << f.inodeId << ")\n";
     }
 }
 
-std::string Directory::getPath() const {
-    if (parentDir == nullptr) return "/"; // 根目录
-    std::string parentPath = parentDir->getPath();
-    return parentPath + (parentPath == "/" ? "" : "/") + dirName;
+const std::string& Directory::getPath() const {
+    return fullPath;
 }
 
 bool Directory::isDirEmpty() const {
@@ -98,32 +155,112 @@ int Directory::getInodeId() const {
     return inodeId;
 }
 
+std::shared_mutex& Directory::entryLock() const {
+    return lock;
+}
+
+void Directory::retainWorkDir() {
+    workRefs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Directory::releaseWorkDir() {
+    workRefs.fetch_sub(1, std::memory_order_relaxed);
+}
+
+int Directory::workDirRefs() const {
+    return workRefs.load(std::memory_order_relaxed);
+}
+
 // directory.cpp
 
-void Directory::serialize(std::ostream& out) {
-    size_t nameLen = dirName.size();
-    out.write(reinterpret_cast<const char*>(&nameLen), sizeof(nameLen));
-    out.write(dirName.c_str(), nameLen);
-    out.write(reinterpret_cast<const char*>(&inodeId), sizeof(inodeId));
+// 目录记录：0 inodeId  4 父目录下标  8 名字偏移  12 名字长度  16 首个文件项  20 文件项数  24 子目录数
+// 文件项记录：0 inodeId  4 类型  8 名字偏移  12 名字长度
+void Directory::packTree(std::vector<char>& dirs, std::vector<char>& entries, std::string& strings) const {
+    using namespace metadata;
+    // 广度优先展开：子目录总排在父目录之后，加载时单趟即可建树
+    std::vector<const Directory*> order{this};
+    std::vector<uint32_t> parents{NO_PARENT};
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (const auto& sub : order[i]->subdirs) {
+            order.push_back(sub.get());
+            parents.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    dirs.assign(order.size() * DIR_RECORD_SIZE, 0);
+    for (size_t i = 0; i < order.size(); ++i) {
+        const Directory* d = order[i];
+        char* rec = dirs.data() + i * DIR_RECORD_SIZE;
+        putU32(rec, static_cast<uint32_t>(d->inodeId));
+        putU32(rec + 4, parents[i]);
+        putU32(rec + 8, static_cast<uint32_t>(strings.size()));
+        putU32(rec + 12, static_cast<uint32_t>(d->dirName.size()));
+        putU32(rec + 16, static_cast<uint32_t>(entries.size() / ENTRY_RECORD_SIZE));
+        putU32(rec + 20, static_cast<uint32_t>(d->files.size()));
+        putU32(rec + 24, static_cast<uint32_t>(d->subdirs.size()));
+        strings += d->dirName;
 
-    // 写入子目录数量
-    size_t subdirCount = subdirs.size();
-    out.write(reinterpret_cast<const char*>(&subdirCount), sizeof(subdirCount));
-    for (const auto& sub : subdirs) {
-        sub->serialize(out);
+        size_t pos = entries.size();
+        entries.resize(pos + d->files.size() * ENTRY_RECORD_SIZE, 0);
+        for (const auto& entry : d->files) {
+            char* e = entries.data() + pos;
+            putU32(e, static_cast<uint32_t>(entry.inodeId));
+            putU32(e + 4, static_cast<uint32_t>(entry.type));
+            putU32(e + 8, static_cast<uint32_t>(strings.size()));
+            putU32(e + 12, static_cast<uint32_t>(entry.name.size()));
+            strings += entry.name;
+            pos += ENTRY_RECORD_SIZE;
+        }
     }
+}
+
+std::unique_ptr<Directory> Directory::unpackTree(const char* dirs, size_t dirCount,
+                                                 const char* entries, size_t entryCount,
+                                                 std::string_view strings) {
+    using namespace metadata;
+    auto corrupted = []() { return std::runtime_error("Corrupted directory table"); };
+    auto nameAt = [&](const char* rec) {
+        uint32_t off = getU32(rec), len = getU32(rec + 4);
+        if (off > strings.size() || len > strings.size() - off) throw corrupted();
+        return strings.substr(off, len);
+    };
+    if (dirCount == 0) throw corrupted();
 
-    // 写入文件数量
-    size_t fileCount = files.size();
-    out.write(reinterpret_cast<const char*>(&fileCount), sizeof(fileCount));
-    for (const auto& entry : files) {
-        size_t nameLen = entry.name.size();
-        out.write(reinterpret_cast<const char*>(&nameLen), sizeof(nameLen));
-        out.write(entry.name.c_str(), nameLen);
-        out.write(reinterpret_cast<const char*>(&entry.inodeId), sizeof(entry.inodeId));
-        int type = static_cast<int>(entry.type);
-        out.write(reinterpret_cast<const char*>(&type), sizeof(type));
+    std::unique_ptr<Directory> root;
+    std::vector<Directory*> built(dirCount);
+    for (size_t i = 0; i < dirCount; ++i) {
+        const char* rec = dirs + i * DIR_RECORD_SIZE;
+        int id = static_cast<int32_t>(getU32(rec));
+        uint32_t parent = getU32(rec + 4);
+        std::string name(nameAt(rec + 8));
+        Directory* d;
+        if (i == 0) {
+            if (parent != NO_PARENT) throw corrupted();
+            root = std::make_unique<Directory>(name, id, nullptr);
+            d = root.get();
+        } else {
+            if (parent >= i) throw corrupted();
+            Directory* p = built[parent];
+            p->subdirIndex.insert(name, static_cast<int>(p->subdirs.size()));
+            p->subdirs.push_back(std::make_unique<Directory>(name, id, p));
+            d = p->subdirs.back().get();
+        }
+        built[i] = d;
+
+        uint32_t first = getU32(rec + 16), count = getU32(rec + 20), subCount = getU32(rec + 24);
+        if (first > entryCount || count > entryCount - first || subCount >= dirCount) throw corrupted();
+        d->subdirs.reserve(subCount);
+        d->subdirIndex.reserve(subCount);
+        d->files.reserve(count);
+        d->fileIndex.reserve(count);
+        for (const char* e = entries + first * ENTRY_RECORD_SIZE; count > 0; --count, e += ENTRY_RECORD_SIZE) {
+            std::string_view fileName = nameAt(e + 8);
+            auto type = getU32(e + 4) == DirEntry::DIRECTORY ? DirEntry::DIRECTORY : DirEntry::FILE;
+            d->fileIndex.insert(fileName, static_cast<int>(d->files.size()));
+            d->files.emplace_back(std::string(fileName), static_cast<int32_t>(getU32(e)), type);
+        }
     }
+    return root;
 }
 
 void Directory::deserialize(std::istream& in) {
@@ -137,9 +274,13 @@ void Directory::deserialize(std::istream& in) {
     size_t subdirCount;
     in.read(reinterpret_cast<char*>(&subdirCount), sizeof(subdirCount));
     subdirs.clear();
+    refreshPath(); // 子目录读入时各自根据本目录路径计算
+    subdirIndex.clear();
+    subdirIndex.reserve(subdirCount);
     for (size_t i = 0; i < subdirCount; ++i) {
         auto sub = std::make_unique<Directory>("", 0, this);
         sub->deserialize(in);
+        subdirIndex.insert(sub->dirName, static_cast<int>(subdirs.size()));
         subdirs.push_back(std::move(sub));
     }
 
@@ -147,6 +288,8 @@ void Directory::deserialize(std::istream& in) {
     size_t fileCount;
     in.read(reinterpret_cast<char*>(&fileCount), sizeof(fileCount));
     files.clear();
+    fileIndex.clear();
+    fileIndex.reserve(fileCount);
     for (size_t i = 0; i < fileCount; ++i) {
         size_t len;
         in.read(reinterpret_cast<char*>(&len), sizeof(len));
@@ -155,6 +298,7 @@ void Directory::deserialize(std::istream& in) {
         int inodeId, typeInt;
         in.read(reinterpret_cast<char*>(&inodeId), sizeof(inodeId));
         in.read(reinterpret_cast<char*>(&typeInt), sizeof(typeInt));
+        fileIndex.insert(name, static_cast<int>(files.size()));
         files.emplace_back(name, inodeId, static_cast<DirEntry::EntryType>(typeInt));
     }
 }
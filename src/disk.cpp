@@ -1,50 +1,852 @@
 #include "disk.h"
+#include <algorithm>
+#include <utility>
+#include <cstdio>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
+namespace {
 
-DiskManager::DiskManager() {
-    std::memset(disk, 0, sizeof(disk));
-    std::memset(blockBitmap, 0, sizeof(blockBitmap));
+// 位图字节区间的边界可能被多个线程同时扩大，用比较交换更新
+void atomicMin(int& target, int value) {
+    int cur = __atomic_load_n(&target, __ATOMIC_RELAXED);
+    while (value < cur &&
+           !__atomic_compare_exchange_n(&target, &cur, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void atomicMax(int& target, int value) {
+    int cur = __atomic_load_n(&target, __ATOMIC_RELAXED);
+    while (value > cur &&
+           !__atomic_compare_exchange_n(&target, &cur, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+} // namespace
+
+const char DiskManager::ZERO_BLOCK[DiskManager::BLOCK_SIZE] = {};
+
+DiskManager::DiskManager(int blockCount)
+    : base(nullptr), imageFd(-1), mapBase(nullptr), mapLength(0), eraseOnFree(false), sharedBlocks(0) {
+    resize(blockCount);
+}
+
+DiskManager::~DiskManager() {
+    releaseImage();
+}
+
+DiskManager::DiskManager(DiskManager&& other) noexcept
+    : blockCount(other.blockCount), wordCount(other.wordCount), disk(std::move(other.disk)),
+      base(other.base), imageFd(other.imageFd), imagePath(std::move(other.imagePath)),
+      mapBase(other.mapBase), mapLength(other.mapLength), cache(std::move(other.cache)),
+      savedPath(std::move(other.savedPath)), dirtyWords(std::move(other.dirtyWords)),
+      bitmapDirtyLo(other.bitmapDirtyLo), bitmapDirtyHi(other.bitmapDirtyHi),
+      changedWords(std::move(other.changedWords)),
+      bitmapChangedLo(other.bitmapChangedLo), bitmapChangedHi(other.bitmapChangedHi),
+      zeroWords(std::move(other.zeroWords)), eraseOnFree(other.eraseOnFree),
+      shareRefs(std::move(other.shareRefs)), heldWords(std::move(other.heldWords)),
+      sharedBlocks(other.sharedBlocks),
+      freeWords(std::move(other.freeWords)), summary(std::move(other.summary)),
+      freeCount(other.freeCount.load()), shards(std::move(other.shards)),
+      shardCount(other.shardCount), shardWords(other.shardWords) {
+    other.imageFd = -1;
+    other.mapBase = nullptr;
+    other.mapLength = 0;
+    other.base = nullptr;
+}
+
+DiskManager& DiskManager::operator=(DiskManager&& other) noexcept {
+    if (this != &other) {
+        releaseImage();
+        blockCount = other.blockCount;
+        wordCount = other.wordCount;
+        disk = std::move(other.disk);
+        base = other.base;
+        imageFd = other.imageFd;
+        imagePath = std::move(other.imagePath);
+        mapBase = other.mapBase;
+        mapLength = other.mapLength;
+        cache = std::move(other.cache);
+        savedPath = std::move(other.savedPath);
+        dirtyWords = std::move(other.dirtyWords);
+        bitmapDirtyLo = other.bitmapDirtyLo;
+        bitmapDirtyHi = other.bitmapDirtyHi;
+        changedWords = std::move(other.changedWords);
+        bitmapChangedLo = other.bitmapChangedLo;
+        bitmapChangedHi = other.bitmapChangedHi;
+        shareRefs = std::move(other.shareRefs);
+        heldWords = std::move(other.heldWords);
+        sharedBlocks = other.sharedBlocks;
+        zeroWords = std::move(other.zeroWords);
+        eraseOnFree = other.eraseOnFree;
+        freeWords = std::move(other.freeWords);
+        summary = std::move(other.summary);
+        freeCount = other.freeCount.load();
+        shards = std::move(other.shards);
+        shardCount = other.shardCount;
+        shardWords = other.shardWords;
+        other.imageFd = -1;
+        other.mapBase = nullptr;
+        other.mapLength = 0;
+        other.base = nullptr;
+    }
+    return *this;
+}
+
+void DiskManager::resize(int count) {
+    releaseImage();
+    blockCount = count > 0 ? count : DEFAULT_BLOCK_COUNT;
+    wordCount = (blockCount + WORD_BITS - 1) / WORD_BITS;
+    disk.assign(static_cast<size_t>(blockCount) * BLOCK_SIZE, 0);
+    base = disk.data();
+    savedPath.clear();
+    resetBitmap();
+    clearDirty();
+    clearChanges();
+}
+
+int DiskManager::getBlockCount() const {
+    return blockCount;
+}
+
+void DiskManager::resetBitmap() {
+    freeWords.assign(wordCount, ~0ULL);
+    // 最后一个字中超出磁盘大小的位不可分配
+    int tail = blockCount % WORD_BITS;
+    if (tail != 0) {
+        freeWords[wordCount - 1] = (1ULL << tail) - 1;
+    }
+    int summaryWords = (wordCount + WORD_BITS - 1) / WORD_BITS;
+    summary.assign(summaryWords, 0);
+    for (int w = 0; w < wordCount; ++w) {
+        summary[w / WORD_BITS] |= 1ULL << (w % WORD_BITS);
+    }
+    freeCount = blockCount;
+    zeroWords.assign(wordCount, 0);
+    shareRefs.clear();
+    heldWords.clear();
+    sharedBlocks = 0;
+
+    int perShard = (summaryWords + MAX_ALLOC_SHARDS - 1) / MAX_ALLOC_SHARDS;
+    shardCount = (summaryWords + perShard - 1) / perShard;
+    shardWords = perShard * WORD_BITS;
+    shards = std::make_unique<AllocShard[]>(shardCount);
+    for (int i = 0; i < shardCount; ++i) {
+        shards[i].hintWord = i * shardWords;
+    }
+}
+
+int DiskManager::homeShard() const {
+    // 每个线程第一次分配时领取一个序号，此后总从对应的分片开始；
+    // 单线程时总是分片 0，分配顺序与不分片时相同
+    static std::atomic<int> nextThread{0};
+    thread_local int threadSlot = nextThread.fetch_add(1);
+    return threadSlot % shardCount;
+}
+
+int DiskManager::shardOf(int idx) const {
+    return idx / WORD_BITS / shardWords;
+}
+
+int DiskManager::shardEndWord(int shard) const {
+    return std::min((shard + 1) * shardWords, wordCount);
+}
+
+void DiskManager::markUsed(int idx) {
+    int w = idx / WORD_BITS;
+    freeWords[w] &= ~(1ULL << (idx % WORD_BITS));
+    if (freeWords[w] == 0) setSummaryBit(w, false);
+    freeCount.fetch_sub(1, std::memory_order_relaxed);
+    setBitmapBytes(idx, 1, 1);
+}
+
+void DiskManager::markFree(int idx) {
+    int w = idx / WORD_BITS;
+    freeWords[w] |= 1ULL << (idx % WORD_BITS);
+    setSummaryBit(w, true);
+    freeCount.fetch_add(1, std::memory_order_relaxed);
+    setBitmapBytes(idx, 1, 0);
+}
+
+void DiskManager::setSummaryBit(int w, bool hasFree) {
+    // 修改者持有分片锁，不会丢失更新；用原子存储是因为 shardHasFree 不加锁读取
+    uint64_t& word = summary[w / WORD_BITS];
+    uint64_t bit = 1ULL << (w % WORD_BITS);
+    __atomic_store_n(&word, hasFree ? (word | bit) : (word & ~bit), __ATOMIC_RELAXED);
+}
+
+bool DiskManager::shardHasFree(int shard) const {
+    int first = shard * shardWords / WORD_BITS;
+    int last = (shardEndWord(shard) + WORD_BITS - 1) / WORD_BITS;
+    for (int s = first; s < last; ++s) {
+        if (__atomic_load_n(&summary[s], __ATOMIC_RELAXED)) return true;
+    }
+    return false;
+}
+
+int DiskManager::findFreeWord(int fromWord, int limitWord) const {
+    if (fromWord >= limitWord) return -1;
+    int s = fromWord / WORD_BITS;
+    int lastSummary = (limitWord - 1) / WORD_BITS;
+    // 先查起始 summary 字中不低于 fromWord 的部分，再逐个向后
+    uint64_t bits = summary[s] & (~0ULL << (fromWord % WORD_BITS));
+    while (!bits) {
+        if (++s > lastSummary) return -1;
+        bits = summary[s];
+    }
+    int w = s * WORD_BITS + __builtin_ctzll(bits);
+    return w < limitWord ? w : -1;
+}
+
+int DiskManager::nextFreeBlock(int from, int limit) const {
+    if (from >= limit) return -1;
+    int w = from / WORD_BITS;
+    uint64_t bits = freeWords[w] & (~0ULL << (from % WORD_BITS));
+    if (!bits) {
+        w = findFreeWord(w + 1, (limit + WORD_BITS - 1) / WORD_BITS);
+        if (w == -1) return -1;
+        bits = freeWords[w];
+    }
+    int idx = w * WORD_BITS + __builtin_ctzll(bits);
+    return idx < limit ? idx : -1;
+}
+
+int DiskManager::nextUsedBlock(int from, int limit) const {
+    if (from >= limit) return limit;
+    int w = from / WORD_BITS;
+    int lastWord = (limit - 1) / WORD_BITS;
+    uint64_t bits = ~freeWords[w] & (~0ULL << (from % WORD_BITS));
+    while (!bits) {
+        if (++w > lastWord) return limit;
+        bits = ~freeWords[w];
+    }
+    int idx = w * WORD_BITS + __builtin_ctzll(bits);
+    return std::min(idx, limit);
+}
+
+int DiskManager::findExtent(int count, int from, int lo, int hi) const {
+    // 从 from 开始找第一段长度足够的空闲区间，找不到再从 lo 回绕到 from
+    for (int pass = 0; pass < 2; ++pass) {
+        int pos = pass == 0 ? from : lo;
+        int limit = pass == 0 ? hi : from;
+        while (pos < limit) {
+            int start = nextFreeBlock(pos, limit);
+            if (start == -1) break;
+            int end = nextUsedBlock(start, limit);
+            if (end - start >= count) return start;
+            pos = end;
+        }
+    }
+    return -1;
+}
+
+// 只统计原先已占用的块，重复释放不会使空闲计数出错
+void DiskManager::markFreeRange(int start, int count) {
+    int idx = start;
+    int end = start + count;
+    int freed = 0;
+    while (idx < end) {
+        int w = idx / WORD_BITS;
+        int bit = idx % WORD_BITS;
+        int n = std::min(WORD_BITS - bit, end - idx);
+        uint64_t mask = (n == WORD_BITS) ? ~0ULL : (((1ULL << n) - 1) << bit);
+        freed += __builtin_popcountll(~freeWords[w] & mask);
+        freeWords[w] |= mask;
+        setSummaryBit(w, true);
+        idx += n;
+    }
+    freeCount.fetch_add(freed, std::memory_order_relaxed);
+    setBitmapBytes(start, count, 0);
+}
+
+void DiskManager::markUsedRange(int start, int count) {
+    int idx = start;
+    int end = start + count;
+    while (idx < end) {
+        int w = idx / WORD_BITS;
+        int bit = idx % WORD_BITS;
+        int n = std::min(WORD_BITS - bit, end - idx);
+        uint64_t mask = (n == WORD_BITS) ? ~0ULL : (((1ULL << n) - 1) << bit);
+        freeWords[w] &= ~mask;
+        if (freeWords[w] == 0) setSummaryBit(w, false);
+        idx += n;
+    }
+    freeCount.fetch_sub(count, std::memory_order_relaxed);
+    setBitmapBytes(start, count, 1);
+}
+
+// 相邻的块可能属于不同线程正在写的文件，同一个字用原子或置位
+void DiskManager::setBits(std::vector<uint64_t>& words, int start, int count) {
+    int idx = start;
+    int end = start + count;
+    while (idx < end) {
+        int w = idx / WORD_BITS;
+        int bit = idx % WORD_BITS;
+        int n = std::min(WORD_BITS - bit, end - idx);
+        uint64_t mask = (n == WORD_BITS) ? ~0ULL : (((1ULL << n) - 1) << bit);
+        __atomic_fetch_or(&words[w], mask, __ATOMIC_RELAXED);
+        idx += n;
+    }
+}
+
+void DiskManager::markDirty(int start, int count) {
+    setBits(dirtyWords, start, count);
+    setBits(changedWords, start, count);
+}
+
+bool DiskManager::pendingZero(int idx) const {
+    return __atomic_load_n(&zeroWords[idx / WORD_BITS], __ATOMIC_ACQUIRE) >> (idx % WORD_BITS) & 1ULL;
+}
+
+bool DiskManager::anyPendingZero(int start, int end) const {
+    for (int w = start / WORD_BITS; w * WORD_BITS < end; ++w) {
+        uint64_t bits = __atomic_load_n(&zeroWords[w], __ATOMIC_ACQUIRE);
+        if (w == start / WORD_BITS) bits &= ~0ULL << (start % WORD_BITS);
+        if ((w + 1) * WORD_BITS > end && end % WORD_BITS != 0) bits &= (1ULL << (end % WORD_BITS)) - 1;
+        if (bits) return true;
+    }
+    return false;
+}
+
+// 整块被覆盖的待清零块直接取消标记；只写一部分的先清零。块属于调用方正在写的文件，不会同时被其他线程访问
+void DiskManager::preparePartialWrite(int start, int offset, int length) {
+    int first = start + offset / BLOCK_SIZE;
+    int last = start + (offset + length - 1) / BLOCK_SIZE;
+    if (!anyPendingZero(first, last + 1)) return;
+    long long begin = static_cast<long long>(start) * BLOCK_SIZE + offset;
+    long long end = begin + length;
+    for (int blk = first; blk <= last; ++blk) {
+        if (!pendingZero(blk)) continue;
+        long long blockBegin = static_cast<long long>(blk) * BLOCK_SIZE;
+        if (begin > blockBegin || end < blockBegin + BLOCK_SIZE) {
+            zeroBlocks(blk, 1);
+        } else {
+            __atomic_fetch_and(&zeroWords[blk / WORD_BITS], ~(1ULL << (blk % WORD_BITS)), __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// 读者可能与此并发：先清零再撤销标记，读者要么看到标记返回 0，要么读到已清零的内容
+void DiskManager::fillPendingZeros() {
+    for (int w = 0; w < wordCount; ++w) {
+        uint64_t pending = __atomic_load_n(&zeroWords[w], __ATOMIC_ACQUIRE);
+        if (!pending) continue;
+        uint64_t bits = pending & ~freeWords[w];   // 空闲块不必清零，再分配时会重新标记
+        while (bits) {
+            zeroBlocks(w * WORD_BITS + __builtin_ctzll(bits), 1);
+            bits &= bits - 1;
+        }
+        __atomic_fetch_and(&zeroWords[w], ~pending, __ATOMIC_RELEASE);
+    }
+}
+
+void DiskManager::setSecureErase(bool on) {
+    eraseOnFree = on;
+}
+
+bool DiskManager::secureErase() const {
+    return eraseOnFree;
+}
+
+void DiskManager::clearDirty() {
+    dirtyWords.assign(wordCount, 0);
+    bitmapDirtyLo = blockCount;
+    bitmapDirtyHi = 0;
+}
+
+void DiskManager::clearChanges() {
+    changedWords.assign(wordCount, 0);
+    bitmapChangedLo = blockCount;
+    bitmapChangedHi = 0;
+}
+
+bool DiskManager::changedBitmapRange(int& lo, int& hi) const {
+    lo = bitmapChangedLo;
+    hi = bitmapChangedHi;
+    return lo < hi;
+}
+
+void DiskManager::setBitmapBytes(int start, int count, char value) {
+    if (mapBase) {
+        char* bytes = mapBase + static_cast<size_t>(blockCount) * BLOCK_SIZE;
+        for (int i = start; i < start + count; ++i) {
+            if (bytes[i] != value) bytes[i] = value; // 避免无谓地弄脏页面
+        }
+    }
+    atomicMin(bitmapDirtyLo, start);
+    atomicMax(bitmapDirtyHi, start + count);
+    atomicMin(bitmapChangedLo, start);
+    atomicMax(bitmapChangedHi, start + count);
+}
+
+char* DiskManager::blockPtr(int idx, bool forWrite) {
+    if (forWrite) markDirty(idx, 1);
+    if (cache) return cache->get(idx, forWrite);
+    return base + static_cast<size_t>(idx) * BLOCK_SIZE;
+}
+
+void DiskManager::zeroBlocks(int start, int count) {
+    if (cache) {
+        std::lock_guard<std::mutex> guard(cacheLock);
+        for (int i = start; i < start + count; ++i) {
+            std::memset(blockPtr(i, true), 0, BLOCK_SIZE);
+        }
+    } else {
+        std::memset(base + static_cast<size_t>(start) * BLOCK_SIZE, 0, static_cast<size_t>(count) * BLOCK_SIZE);
+        markDirty(start, count);
+    }
+    for (int i = start; i < start + count; ++i) {
+        __atomic_fetch_and(&zeroWords[i / WORD_BITS], ~(1ULL << (i % WORD_BITS)), __ATOMIC_RELEASE);
+    }
 }
 
-void DiskManager::loadDisk(const std::string& filename) {
-    std::ifstream in(filename, std::ios::binary);
-    if (!in) return;
+bool DiskManager::loadDisk(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    if (!in) return false;
+
+    // 镜像布局：全部块数据，随后每块一个字节的位图；块数由文件大小推出
+    std::streamoff fileSize = in.tellg();
+    int count = static_cast<int>(fileSize / (BLOCK_SIZE + 1));
+    if (count <= 0) return false;
+    if (count != blockCount || imageFd != -1) resize(count);
 
-    in.read(reinterpret_cast<char*>(disk), sizeof(disk));
-    in.read(reinterpret_cast<char*>(blockBitmap), sizeof(blockBitmap));
+    std::vector<char> blockBitmap(blockCount);
+    in.seekg(0);
+    in.read(disk.data(), disk.size());
+    in.read(blockBitmap.data(), blockBitmap.size());
+    if (!in) return false;
     in.close();
+
+    resetBitmap();
+    for (int i = 0; i < blockCount; ++i) {
+        if (blockBitmap[i]) markUsed(i);
+    }
+    clearDirty();
+    clearChanges();
+    savedPath = filename;
+    return true;
+}
+
+bool DiskManager::saveDisk(const std::string& filename) {
+    // 保存到当前打开的镜像时只需写回脏块，截断重写会使映射失效
+    if (imageFd != -1 && filename == imagePath) {
+        return sync();
+    }
+    fillPendingZeros();
+    // 先写临时文件并落盘，再改名替换，崩溃时旧镜像保持完整
+    std::string tmpPath = filename + ".tmp";
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+
+    off_t offset = 0;
+    bool ok = true;
+    auto put = [&](const char* data, size_t length) {
+        while (ok && length > 0) {
+            ssize_t n = ::pwrite(fd, data, length, offset);
+            if (n <= 0) {
+                ok = false;
+                break;
+            }
+            data += n;
+            length -= n;
+            offset += n;
+        }
+    };
+    if (cache) {
+        std::lock_guard<std::mutex> guard(cacheLock);
+        for (int i = 0; i < blockCount; ++i) {
+            put(blockPtr(i, false), BLOCK_SIZE);
+        }
+    } else {
+        put(base, static_cast<size_t>(blockCount) * BLOCK_SIZE);
+    }
+    std::vector<char> blockBitmap(blockCount);
+    for (int i = 0; i < blockCount; ++i) {
+        blockBitmap[i] = isLive(i);
+    }
+    put(blockBitmap.data(), blockBitmap.size());
+    if (ok) ok = ::fdatasync(fd) == 0;
+    ::close(fd);
+    if (!ok || std::rename(tmpPath.c_str(), filename.c_str()) != 0) {
+        ::unlink(tmpPath.c_str());
+        return false;
+    }
+    if (imageFd == -1) {
+        clearDirty();
+        savedPath = filename;
+    }
+    return true;
+}
+
+bool DiskManager::openImage(const std::string& filename, int& count, size_t& length) {
+    int fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    if (st.st_size > 0) {
+        count = static_cast<int>(st.st_size / (BLOCK_SIZE + 1));
+    }
+    length = static_cast<size_t>(count) * (BLOCK_SIZE + 1);
+    if (count <= 0 || (static_cast<size_t>(st.st_size) < length && ::ftruncate(fd, length) != 0)) {
+        ::close(fd);
+        return false;
+    }
+
+    releaseImage();
+    std::vector<char>().swap(disk); // 释放内存模式的缓冲区
+    savedPath.clear();
+    base = nullptr;
+    blockCount = count;
+    wordCount = (blockCount + WORD_BITS - 1) / WORD_BITS;
+    imageFd = fd;
+    imagePath = filename;
+    return true;
+}
+
+bool DiskManager::mapDisk(const std::string& filename, int count) {
+    size_t length;
+    if (!openImage(filename, count, length)) return false;
+    void* addr = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, imageFd, 0);
+    if (addr == MAP_FAILED) {
+        resize(count);
+        return false;
+    }
+    mapBase = static_cast<char*>(addr);
+    mapLength = length;
+    base = mapBase;
+
+    // 只扫描位图字节重建空闲位图，块数据由系统在访问时调入
+    resetBitmap();
+    const char* bytes = mapBase + static_cast<size_t>(blockCount) * BLOCK_SIZE;
+    for (int i = 0; i < blockCount; ++i) {
+        if (bytes[i]) markUsed(i);
+    }
+    clearDirty();
+    clearChanges();
+    return true;
+}
+
+bool DiskManager::openCached(const std::string& filename, int cacheBlocks, int count) {
+    size_t length;
+    if (!openImage(filename, count, length)) return false;
+    cache = std::make_unique<BlockCache>(imageFd, BLOCK_SIZE, cacheBlocks);
+
+    std::vector<char> blockBitmap(blockCount);
+    ::pread(imageFd, blockBitmap.data(), blockBitmap.size(), static_cast<off_t>(blockCount) * BLOCK_SIZE);
+    resetBitmap();
+    for (int i = 0; i < blockCount; ++i) {
+        if (blockBitmap[i]) markUsed(i);
+    }
+    clearDirty();
+    clearChanges();
+    return true;
+}
+
+bool DiskManager::writeDirtyBitmap(int fd) const {
+    if (bitmapDirtyLo >= bitmapDirtyHi) return true;
+    std::vector<char> bytes(bitmapDirtyHi - bitmapDirtyLo);
+    for (int i = bitmapDirtyLo; i < bitmapDirtyHi; ++i) {
+        bytes[i - bitmapDirtyLo] = isLive(i);
+    }
+    off_t offset = static_cast<off_t>(blockCount) * BLOCK_SIZE + bitmapDirtyLo;
+    return ::pwrite(fd, bytes.data(), bytes.size(), offset) == static_cast<ssize_t>(bytes.size());
+}
+
+bool DiskManager::sync() {
+    fillPendingZeros();
+    bool ok = true;
+    if (mapBase) {
+        size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        auto flush = [&](size_t begin, size_t end) {
+            size_t aligned = begin / page * page;
+            if (::msync(mapBase + aligned, end - aligned, MS_SYNC) != 0) ok = false;
+        };
+        forEachDirtyRun([&](int start, int count) {
+            flush(static_cast<size_t>(start) * BLOCK_SIZE, static_cast<size_t>(start + count) * BLOCK_SIZE);
+        });
+        if (bitmapDirtyLo < bitmapDirtyHi) {
+            size_t bitmapOffset = static_cast<size_t>(blockCount) * BLOCK_SIZE;
+            flush(bitmapOffset + bitmapDirtyLo, bitmapOffset + bitmapDirtyHi);
+        }
+    } else if (cache) {
+        std::lock_guard<std::mutex> guard(cacheLock);
+        ok = cache->sync();
+        ok = writeDirtyBitmap(imageFd) && ::fdatasync(imageFd) == 0 && ok;
+    } else {
+        // 内存模式：按连续脏块区间原地改写上次保存的镜像，不再整体重写
+        if (savedPath.empty()) return false;
+        int fd = ::open(savedPath.c_str(), O_WRONLY);
+        if (fd < 0) return false;
+        forEachDirtyRun([&](int start, int count) {
+            size_t offset = static_cast<size_t>(start) * BLOCK_SIZE;
+            size_t length = static_cast<size_t>(count) * BLOCK_SIZE;
+            if (ok) ok = ::pwrite(fd, base + offset, length, static_cast<off_t>(offset)) == static_cast<ssize_t>(length);
+        });
+        ok = ok && writeDirtyBitmap(fd) && ::fdatasync(fd) == 0;
+        ::close(fd);
+    }
+    if (ok) clearDirty();
+    return ok;
+}
+
+void DiskManager::releaseImage() {
+    if (imageFd == -1) return;
+    sync();
+    if (mapBase) ::munmap(mapBase, mapLength);
+    cache.reset();
+    ::close(imageFd);
+    mapBase = nullptr;
+    mapLength = 0;
+    imageFd = -1;
+    imagePath.clear();
+    base = disk.data();
+}
+
+void DiskManager::closeImage() {
+    if (imageFd == -1) return;
+    resize(blockCount);
+}
+
+bool DiskManager::isMapped() const {
+    return mapBase != nullptr;
+}
+
+bool DiskManager::isCached() const {
+    return cache != nullptr;
 }
 
-void DiskManager::saveDisk(const std::string& filename) {
-    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
-    if (!out) return;
+const BlockCache* DiskManager::getCache() const {
+    return cache.get();
+}
 
-    out.write(reinterpret_cast<const char*>(disk), sizeof(disk));
-    out.write(reinterpret_cast<const char*>(blockBitmap), sizeof(blockBitmap));
-    out.close();
+const std::string& DiskManager::imageFile() const {
+    return imagePath;
 }
 
 int DiskManager::allocateBlock() {
-    for (int i = 0; i < BLOCK_COUNT; ++i) {
-        if (!blockBitmap[i]) {
-            blockBitmap[i] = true;
-            std::memset(disk[i], 0, BLOCK_SIZE); // 可选清空块内容
-            return i;
+    int home = homeShard();
+    for (int i = 0; i < shardCount; ++i) {
+        int s = (home + i) % shardCount;
+        if (!shardHasFree(s)) continue;    // 已满的片不必加锁查找；接近满盘时大多数片都是这样
+        AllocShard& shard = shards[s];
+        int idx;
+        {
+            std::lock_guard<std::mutex> guard(shard.lock);
+            int w = findFreeWord(shard.hintWord, shardEndWord(s));
+            if (w == -1) w = findFreeWord(s * shardWords, shard.hintWord);
+            if (w == -1) continue; // 本片已满，换下一片
+
+            idx = w * WORD_BITS + __builtin_ctzll(freeWords[w]);
+            markUsed(idx);
+            shard.hintWord = w;
         }
+        setBits(zeroWords, idx, 1); // 不立即清零，读取时按 0 返回
+        return idx;
     }
     return -1; // 无空闲块可用
 }
 
+int DiskManager::allocateExtent(int count, int hint) {
+    if (count <= 0 || count > freeBlockCount()) return -1;
+    bool hinted = hint >= 0 && hint < blockCount;
+    int home = hinted ? shardOf(hint) : homeShard();
+
+    // 先在单个分片内查找，从 hint 所在（或当前线程的）分片开始依次尝试
+    for (int i = 0; i < shardCount; ++i) {
+        int s = (home + i) % shardCount;
+        int lo = s * shardWords * WORD_BITS;
+        int hi = std::min(shardEndWord(s) * WORD_BITS, blockCount);
+        if (hi - lo < count) continue;
+        AllocShard& shard = shards[s];
+        int start;
+        {
+            std::lock_guard<std::mutex> guard(shard.lock);
+            int from = (i == 0 && hinted) ? hint : shard.hintWord * WORD_BITS;
+            start = findExtent(count, from, lo, hi);
+            if (start == -1) continue;
+            markUsedRange(start, count);
+            int next = (start + count) / WORD_BITS;
+            shard.hintWord = next < shardEndWord(s) ? next : s * shardWords;
+        }
+        setBits(zeroWords, start, count);
+        return start;
+    }
+    if (shardCount == 1) return -1;
+
+    // 跨越分片边界的区间：按分片序号从小到大锁住全部分片，再在整个位图中查找
+    std::vector<std::unique_lock<std::mutex>> held;
+    held.reserve(shardCount);
+    for (int s = 0; s < shardCount; ++s) {
+        held.emplace_back(shards[s].lock);
+    }
+    int start = findExtent(count, hinted ? hint : 0, 0, blockCount);
+    if (start == -1) return -1;
+    markUsedRange(start, count);
+    held.clear();
+    setBits(zeroWords, start, count);
+    return start;
+}
+
 void DiskManager::freeBlock(int idx) {
-    if (idx >= 0 && idx < BLOCK_COUNT) {
-        blockBitmap[idx] = false;
-        std::memset(disk[idx], 0, BLOCK_SIZE); // 可选清空内容
+    if (idx >= 0 && idx < blockCount) {
+        if (isShared(idx)) {
+            holdBlock(idx);
+            return;
+        }
+        // 安全擦除时先清空再放回空闲位图，避免清掉其他线程刚分配到的块
+        if (eraseOnFree) zeroBlocks(idx, 1);
+        std::lock_guard<std::mutex> guard(shards[shardOf(idx)].lock);
+        if (isAllocated(idx)) markFree(idx);
+    }
+}
+
+void DiskManager::freeExtent(int start, int count) {
+    int end = std::min(start + count, blockCount);
+    start = std::max(start, 0);
+    if (start >= end) return;
+    if (hasShared()) {
+        // 有快照时逐块判断，被引用的块只转为由快照保留
+        for (int idx = start; idx < end; ++idx) freeBlock(idx);
+        return;
+    }
+    if (eraseOnFree) zeroBlocks(start, end - start);
+    // 按分片切开，每片只加一次锁
+    for (int idx = start; idx < end;) {
+        int shard = shardOf(idx);
+        int limit = std::min(end, shardEndWord(shard) * WORD_BITS);
+        std::lock_guard<std::mutex> guard(shards[shard].lock);
+        markFreeRange(idx, limit - idx);
+        idx = limit;
     }
 }
 
 char* DiskManager::getBlock(int idx) {
-    if (idx >= 0 && idx < BLOCK_COUNT) {
-        return disk[idx];
+    if (idx >= 0 && idx < blockCount) {
+        if (pendingZero(idx)) zeroBlocks(idx, 1);
+        std::unique_lock<std::mutex> guard(cacheLock, std::defer_lock);
+        if (cache) guard.lock();
+        return blockPtr(idx, true); // 返回可写指针，保守地视为已修改
     }
     return nullptr;
 }
+
+bool DiskManager::validRange(int start, int offset, int length) const {
+    if (start < 0 || offset < 0 || length < 0) return false;
+    long long begin = static_cast<long long>(start) * BLOCK_SIZE + offset;
+    return begin + length <= static_cast<long long>(blockCount) * BLOCK_SIZE;
+}
+
+bool DiskManager::readBlocks(int start, int offset, int length, char* dst) {
+    if (!validRange(start, offset, length)) return false;
+    if (length == 0) return true;
+    int blk = start + offset / BLOCK_SIZE;
+    if (!cache && !anyPendingZero(blk, start + (offset + length - 1) / BLOCK_SIZE + 1)) {
+        std::memcpy(dst, base + static_cast<size_t>(start) * BLOCK_SIZE + offset, length); // 连续块在内存中相邻，一次拷贝完成
+        return true;
+    }
+    std::unique_lock<std::mutex> guard(cacheLock, std::defer_lock);
+    if (cache) guard.lock();
+    int inBlock = offset % BLOCK_SIZE;
+    while (length > 0) {
+        int n = std::min(length, BLOCK_SIZE - inBlock);
+        if (pendingZero(blk)) std::memset(dst, 0, n);
+        else if (cache) std::memcpy(dst, blockPtr(blk, false) + inBlock, n);
+        else std::memcpy(dst, base + static_cast<size_t>(blk) * BLOCK_SIZE + inBlock, n);
+        dst += n;
+        length -= n;
+        ++blk;
+        inBlock = 0;
+    }
+    return true;
+}
+
+bool DiskManager::writeBlocks(int start, int offset, int length, const char* src) {
+    if (!validRange(start, offset, length)) return false;
+    if (length > 0) preparePartialWrite(start, offset, length);
+    if (!cache) {
+        std::memcpy(base + static_cast<size_t>(start) * BLOCK_SIZE + offset, src, length);
+        if (length > 0) {
+            int first = start + offset / BLOCK_SIZE;
+            int last = start + (offset + length - 1) / BLOCK_SIZE;
+            markDirty(first, last - first + 1);
+        }
+        return true;
+    }
+    std::lock_guard<std::mutex> guard(cacheLock);
+    int blk = start + offset / BLOCK_SIZE;
+    int inBlock = offset % BLOCK_SIZE;
+    while (length > 0) {
+        int n = std::min(length, BLOCK_SIZE - inBlock);
+        std::memcpy(blockPtr(blk, true) + inBlock, src, n);
+        src += n;
+        length -= n;
+        ++blk;
+        inBlock = 0;
+    }
+    return true;
+}
+
+bool DiskManager::isAllocated(int idx) const {
+    if (idx < 0 || idx >= blockCount) return false;
+    return !(freeWords[idx / WORD_BITS] & (1ULL << (idx % WORD_BITS)));
+}
+
+int DiskManager::freeBlockCount() const {
+    return freeCount.load(std::memory_order_relaxed);
+}
+
+void DiskManager::shareBlock(int idx) {
+    if (!isAllocated(idx)) return;
+    if (shareRefs.empty()) {
+        shareRefs.assign(blockCount, 0);
+        heldWords.assign(wordCount, 0);
+    }
+    if (shareRefs[idx]++ == 0) ++sharedBlocks;
+}
+
+void DiskManager::unshareBlock(int idx) {
+    if (!isShared(idx) || --shareRefs[idx] > 0) return;
+    --sharedBlocks;
+    uint64_t bit = 1ULL << (idx % WORD_BITS);
+    if (heldWords[idx / WORD_BITS] & bit) {
+        heldWords[idx / WORD_BITS] &= ~bit;
+        if (eraseOnFree) zeroBlocks(idx, 1);
+        std::lock_guard<std::mutex> guard(shards[shardOf(idx)].lock);
+        markFree(idx);
+    }
+}
+
+void DiskManager::adoptBlock(int idx) {
+    if (!isShared(idx)) return;
+    uint64_t bit = 1ULL << (idx % WORD_BITS);
+    if (heldWords[idx / WORD_BITS] & bit) {
+        heldWords[idx / WORD_BITS] &= ~bit;
+        setBitmapBytes(idx, 1, 1);
+    }
+}
+
+bool DiskManager::isShared(int idx) const {
+    return sharedBlocks > 0 && idx >= 0 && idx < blockCount && shareRefs[idx] > 0;
+}
+
+bool DiskManager::hasShared() const {
+    return sharedBlocks > 0;
+}
+
+bool DiskManager::isLive(int idx) const {
+    if (!isAllocated(idx)) return false;
+    return heldWords.empty() || !(heldWords[idx / WORD_BITS] & (1ULL << (idx % WORD_BITS)));
+}
+
+// 块仍占用，但在镜像位图中记为空闲；不同线程可能同时保留同一个字中的块
+void DiskManager::holdBlock(int idx) {
+    setBits(heldWords, idx, 1);
+    setBitmapBytes(idx, 1, 0);
+}
@@ -1,92 +1,228 @@
 #include "fileop.h"
 #include <iostream>
-#include <sstream>
-#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+#include <chrono>
+#include <iomanip>
+#include <map>
 
-FileOp::FileOp(FileSystemContext& fsCtx) : fs(fsCtx) {}
+namespace {
+
+// 与原来 stringstream >> 的分隔符一致：制表符和 Windows 换行留下的 \r 也作为空白
+constexpr std::string_view WHITESPACE = " \t\r\n\v\f";
+
+int toInt(std::string_view s) {
+    int value = 0;
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+    if (ec != std::errc() || end != s.data() + s.size()) {
+        throw std::invalid_argument("invalid number: " + std::string(s));
+    }
+    return value;
+}
+
+// 整行只有 exit 一个词
+bool isExit(const FileOp::Args& args) {
+    return args.size() == 1 && args[0] == "exit";
+}
+
+} // namespace
+
+FileOp::FileOp(FileSystemContext& fsCtx) : fs(fsCtx) {
+    registerBuiltins();
+}
 
 void FileOp::run() {
     std::cout << "Simple File System. Type 'help' for commands." << std::endl;
     std::string line;
     while (true) {
-        std::cout << fs.pwd() << "> ";
-        std::getline(std::cin, line);
-        if (line.empty()) continue;
-        if (line == "exit") {
-            std::cout << "Exiting..." << std::endl;
+        std::cout << fs.pwd() << "> " << std::flush;
+        if (!std::getline(std::cin, line)) break;
+        Args args;
+        tokenize(line, args);
+        if (args.size() == 0) continue;
+        if (isExit(args)) {
+            std::cout << "Exiting...\n";
             break;
         }
         executeCommand(line);
     }
 }
 
-void FileOp::executeCommand(const std::string& line) {
-    auto tokens = split(line, ' ');
-    if (tokens.empty()) return;
+void FileOp::runBatch(std::istream& in, std::ostream& report) {
+    struct Timing {
+        long long count = 0;
+        std::chrono::nanoseconds total{0};
+    };
+    std::map<std::string, Timing, std::less<>> timings;
+    using Clock = std::chrono::steady_clock;
+    auto begin = Clock::now();
 
-    const std::string& cmd = tokens[0];
-    try {
-        if (cmd == "exit") {
-            return;
-        } else if (cmd == "help") {
-            printHelp();
-        } else if (cmd == "pwd") {
-            std::cout << fs.pwd() << std::endl;
-        } else if (cmd == "ls") {
-            if (tokens.size() == 1) fs.ls();
-            else fs.ls(tokens[1]);
-        } else if (cmd == "cd" && tokens.size() > 1) {
-            fs.cd(tokens[1]);
-        } else if (cmd == "mkdir" && tokens.size() > 1) {
-            fs.mkdir(tokens[1]);
-        } else if (cmd == "rmdir" && tokens.size() > 1) {
-            fs.rmdir(tokens[1]);
-        } else if (cmd == "create" && tokens.size() > 2) {
-            fs.createFile(tokens[1], tokens[2]);
-        } else if (cmd == "read" && tokens.size() > 1) {
-            fs.readFile(tokens[1]);
-        } else if (cmd == "append" && tokens.size() > 2) {
-            fs.appendFile(tokens[1], tokens[2]);
-        } else if (cmd == "overwrite" && tokens.size() > 2) {
-            fs.overwriteFile(tokens[1], tokens[2]);
-        } else if (cmd == "rm" && tokens.size() > 1) {
-            fs.rm(tokens[1]);
-        } else if (cmd == "save" && tokens.size() > 1) {
-            fs.save(tokens[1]);
-        } else if (cmd == "load" && tokens.size() > 1) {
-            fs.load(tokens[1]);
-        } else {
-            std::cout << "Unknown or invalid command. Type 'help' for help." << std::endl;
+    std::string line;
+    int pending = 0;
+    fs.beginBatch();
+    while (std::getline(in, line)) {
+        Args args;
+        tokenize(line, args);
+        if (args.size() == 0 || args[0][0] == '#') continue;
+        if (isExit(args)) break;
+
+        auto start = Clock::now();
+        executeCommand(line);
+        std::string_view name = args[0];
+        auto it = timings.find(name);
+        if (it == timings.end()) it = timings.emplace(std::string(name), Timing{}).first;
+        Timing& t = it->second;
+        ++t.count;
+        t.total += Clock::now() - start;
+        if (++pending == BATCH_COMMANDS) {
+            fs.endBatch();
+            fs.beginBatch();
+            pending = 0;
         }
-    } catch (const std::exception& e) {
-        std::cout << "Error: " << e.what() << std::endl;
     }
+    fs.endBatch();
+    std::cout.flush();
+
+    auto ms = [](std::chrono::nanoseconds d) { return std::chrono::duration<double, std::milli>(d).count(); };
+    long long commands = 0;
+    report << std::left << std::setw(12) << "command" << std::right << std::setw(10) << "count"
+           << std::setw(12) << "total ms" << std::setw(10) << "avg us" << '\n';
+    for (const auto& [cmd, t] : timings) {
+        report << std::left << std::setw(12) << cmd << std::right << std::setw(10) << t.count
+               << std::setw(12) << std::fixed << std::setprecision(2) << ms(t.total)
+               << std::setw(10) << ms(t.total) * 1000 / t.count << '\n';
+        commands += t.count;
+    }
+    report << commands << " commands in " << ms(Clock::now() - begin) << " ms" << std::endl;
 }
 
-std::vector<std::string> FileOp::split(const std::string& str, char delim) const {
-    std::vector<std::string> result;
-    std::stringstream ss(str);
-    std::string token;
-    while (std::getline(ss, token, delim)) {
-        if (!token.empty()) result.push_back(token);
+void FileOp::registerCommand(std::string_view name, size_t minArgs, std::string_view usage,
+                             std::string_view help, Handler handler) {
+    auto it = table.find(name);
+    Command* cmd = it != table.end() ? it->second : &commands.emplace_back();
+    if (it == table.end()) {
+        cmd->name = name;
+        table.emplace(cmd->name, cmd);
     }
-    return result;
+    cmd->minArgs = minArgs;
+    cmd->usage = usage;
+    cmd->help = help;
+    cmd->run = std::move(handler);
+}
+
+const FileOp::Command* FileOp::findCommand(std::string_view name) const {
+    auto it = table.find(name);
+    return it == table.end() ? nullptr : it->second;
+}
+
+void FileOp::tokenize(std::string_view line, Args& args) {
+    args.count = 0;
+    size_t pos = 0;
+    while (args.count < MAX_TOKENS) {
+        pos = line.find_first_not_of(WHITESPACE, pos);
+        if (pos == std::string_view::npos) break;
+        size_t end = line.find_first_of(WHITESPACE, pos);
+        if (end == std::string_view::npos) end = line.size();
+        args.tokens[args.count++] = line.substr(pos, end - pos);
+        pos = end;
+    }
+}
+
+// 参数个数含命令名；FileSystemContext 的接口取 std::string，在这里才转换
+void FileOp::registerBuiltins() {
+    auto str = [](std::string_view s) { return std::string(s); };
+    registerCommand("help", 1, "help", "Show this help message", [this](const Args&) { printHelp(); });
+    registerCommand("exit", 1, "exit", "Exit the system", [](const Args&) {});
+    registerCommand("pwd", 1, "pwd", "Show current directory",
+                    [this](const Args&) { std::cout << fs.pwd() << '\n'; });
+    registerCommand("ls", 1, "ls [path]", "List directory contents", [this, str](const Args& a) {
+        if (a.size() == 1) fs.ls();
+        else fs.ls(str(a[1]));
+    });
+    registerCommand("cd", 2, "cd <path>", "Change directory",
+                    [this, str](const Args& a) { fs.cd(str(a[1])); });
+    registerCommand("mkdir", 2, "mkdir <path>", "Create a directory",
+                    [this, str](const Args& a) { fs.mkdir(str(a[1])); });
+    registerCommand("rmdir", 2, "rmdir <name>", "Remove an empty directory",
+                    [this, str](const Args& a) { fs.rmdir(str(a[1])); });
+    registerCommand("create", 3, "create <name> <content>", "Create a file with content",
+                    [this, str](const Args& a) { fs.createFile(str(a[1]), str(a[2])); });
+    registerCommand("read", 2, "read <name>", "Read file content",
+                    [this, str](const Args& a) { fs.readFile(str(a[1])); });
+    registerCommand("append", 3, "append <name> <content>", "Append content to a file",
+                    [this, str](const Args& a) { fs.appendFile(str(a[1]), str(a[2])); });
+    registerCommand("overwrite", 3, "overwrite <name> <content>", "Overwrite file content",
+                    [this, str](const Args& a) { fs.overwriteFile(str(a[1]), str(a[2])); });
+    registerCommand("truncate", 3, "truncate <name> <size>", "Shrink or extend a file to <size> bytes",
+                    [this, str](const Args& a) { fs.truncate(str(a[1]), toInt(a[2])); });
+    registerCommand("rm", 2, "rm [-r] <path>", "Delete a file, or a whole directory tree with -r",
+                    [this, str](const Args& a) {
+        if (a[1] != "-r") fs.rm(str(a[1]));
+        else if (a.size() > 2) fs.removeTree(str(a[2]));
+        else printUsage("rm");
+    });
+    registerCommand("cp", 3, "cp [-r] <src> <dst>", "Copy a file or a whole directory tree", [this, str](const Args& a) {
+        size_t first = a[1] == "-r" ? 2 : 1;
+        if (a.size() > first + 1) fs.copy(str(a[first]), str(a[first + 1]));
+        else printUsage("cp");
+    });
+    registerCommand("du", 1, "du [path]", "Show bytes, blocks, files and directories under a path",
+                    [this, str](const Args& a) {
+        FileSystemContext::Usage u = fs.du(a.size() > 1 ? str(a[1]) : "");
+        std::cout << u.bytes << " bytes, " << u.blocks << " blocks, " << u.files << " files, " << u.dirs
+                  << " directories\n";
+    });
+    registerCommand("mv", 3, "mv <src> <dst>", "Move or rename a file or directory",
+                    [this, str](const Args& a) { fs.mv(str(a[1]), str(a[2])); });
+    registerCommand("import", 3, "import <hostdir> <path>", "Copy a host directory tree into <path>",
+                    [this, str](const Args& a) { fs.importTree(str(a[1]), str(a[2])); });
+    registerCommand("export", 3, "export <path> <hostdir>", "Copy the tree under <path> out to a host directory",
+                    [this, str](const Args& a) { fs.exportTree(str(a[1]), str(a[2])); });
+    registerCommand("save", 2, "save <filename>", "Save virtual disk",
+                    [this, str](const Args& a) { fs.save(str(a[1])); });
+    registerCommand("load", 2, "load <filename>", "Load virtual disk",
+                    [this, str](const Args& a) { fs.load(str(a[1])); });
+    registerCommand("mount", 2, "mount <filename> [cache]",
+                    "Open virtual disk in place (mmap, or a block cache of [cache] blocks)",
+                    [this, str](const Args& a) { fs.mount(str(a[1]), a.size() > 2 ? toInt(a[2]) : 0); });
+    registerCommand("snapshot", 2, "snapshot [-d] <name>", "Take a copy-on-write snapshot, or delete one with -d",
+                    [this, str](const Args& a) {
+        if (a[1] != "-d") fs.snapshot(str(a[1]));
+        else if (a.size() > 2) fs.deleteSnapshot(str(a[2]));
+        else printUsage("snapshot");
+    });
+    registerCommand("snapshots", 1, "snapshots", "List snapshots", [this](const Args&) {
+        for (const std::string& name : fs.listSnapshots()) std::cout << name << '\n';
+    });
+    registerCommand("rollback", 2, "rollback <name>", "Return the whole file system to a snapshot",
+                    [this, str](const Args& a) { fs.rollback(str(a[1])); });
+}
+
+void FileOp::executeCommand(std::string_view line) {
+    Args args;
+    tokenize(line, args);
+    if (args.size() == 0) return;
+
+    const Command* cmd = findCommand(args[0]);
+    if (!cmd || args.size() < cmd->minArgs) {
+        std::cout << "Unknown or invalid command. Type 'help' for help.\n";
+        return;
+    }
+    try {
+        cmd->run(args);
+    } catch (const std::exception& e) {
+        std::cout << "Error: " << e.what() << '\n';
+    }
+}
+
+void FileOp::printUsage(std::string_view name) const {
+    if (const Command* cmd = findCommand(name)) std::cout << "Usage: " << cmd->usage << '\n';
 }
 
 void FileOp::printHelp() const {
-    std::cout << "Available commands:\n"
-              << "  help                         Show this help message\n"
-              << "  exit                         Exit the system\n"
-              << "  pwd                          Show current directory\n"
-              << "  ls [path]                    List directory contents\n"
-              << "  cd <path>                    Change directory\n"
-              << "  mkdir <path>                 Create a directory\n"
-              << "  rmdir <name>                 Remove an empty directory\n"
-              << "  create <name> <content>      Create a file with content\n"
-              << "  read <name>                  Read file content\n"
-              << "  append <name> <content>      Append content to a file\n"
-              << "  overwrite <name> <content>   Overwrite file content\n"
-              << "  rm <name>                    Delete a file\n"
-              << "  save <filename>              Save virtual disk\n"
-              << "  load <filename>              Load virtual disk\n";
+    std::cout << "Available commands:\n";
+    for (const Command& cmd : commands) {
+        std::cout << "  " << std::left << std::setw(29) << cmd.usage << cmd.help << '\n';
+    }
+    std::cout << std::right;
 }
@@ -1,114 +1,302 @@
 #include "fs.h"
+#include "metadata.h"
+#include "host_reader.h"
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <climits>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
 
-FileSystemContext::FileSystemContext(){
+FileSystemContext::FileSystemContext(int blockCount)
+    : treeGeneration(0), diskManager(blockCount), batchDepth(0), namespaceDirty(false),
+      locks(std::make_unique<Locks>()), dentryCacheSize(0) {
         int rootInodeId = inodeManager.allocateInode(Inode::DIRECTORY);
         root = std::make_unique<Directory>("", rootInodeId, nullptr);
-        current = root.get();
+        setWorkDir(current, root.get());
 }
 
 
 
-std::vector<std::string> FileSystemContext::splitPath(const std::string& path){
-    std::vector<std::string> parts;
-    std::stringstream ss(path);
-    std::string item;
-    while (std::getline(ss, item, '/')) {
-        if (!item.empty()) parts.push_back(item);
+Directory* FileSystemContext::traverse(Directory* cwd, const std::string& path, bool createMissing) {
+    Directory* start = (path.empty() || path[0] != '/') ? cwd : root.get();
+
+    // 先查路径缓存；命中时不必逐级查找
+    {
+        std::shared_lock<std::shared_mutex> guard(locks->dentries);
+        auto base = dentryCache.find(start);
+        if (base != dentryCache.end()) {
+            auto hit = base->second.find(path);
+            if (hit != base->second.end()) return hit->second;
+        }
     }
-    return parts;
-}
 
-Directory* FileSystemContext::traverse(const std::string& path, bool createMissing) {
-    Directory* dir = (path.empty() || path[0] != '/') ? current : root.get();
-    auto parts = splitPath(path);
-    for (const auto& part : parts) {
-        Directory* next = dir->findSubdir(part);
+    // 用 string_view 逐段切分路径，不分配临时字符串；每一级只在查找时持有该目录的锁
+    std::string_view rest(path);
+    Directory* dir = start;
+    size_t pos = 0;
+    while (pos < rest.size()) {
+        if (rest[pos] == '/') {
+            ++pos;
+            continue;
+        }
+        size_t end = rest.find('/', pos);
+        if (end == std::string_view::npos) end = rest.size();
+        std::string_view part = rest.substr(pos, end - pos);
+        pos = end;
+
+        Directory* next;
+        {
+            std::shared_lock<std::shared_mutex> guard(dir->entryLock());
+            next = dir->findSubdir(part);
+        }
         if (!next) {
-            if (createMissing) {
+            if (!createMissing) return nullptr;
+            std::unique_lock<std::shared_mutex> guard(dir->entryLock());
+            next = dir->findSubdir(part); // 可能已被其他线程创建
+            if (!next) {
                 int newInode = inodeManager.allocateInode(Inode::DIRECTORY);
-                next = dir->addSubdir(part, newInode);
-            } else {
-                return nullptr;
+                next = dir->addSubdir(std::string(part), newInode);
+                recordLink(dir, next->getName(), newInode, DirEntry::DIRECTORY);
             }
         }
         dir = next;
     }
+
+    std::unique_lock<std::shared_mutex> guard(locks->dentries);
+    if (dentryCacheSize >= DENTRY_CACHE_LIMIT) invalidateDentries();
+    if (dentryCache[start].emplace(path, dir).second) ++dentryCacheSize;
     return dir;
 }
 
-void FileSystemContext::mkdir(const std::string& path) {
-    if (!traverse(path, true)) {
+void FileSystemContext::invalidateDentries() {
+    dentryCache.clear();
+    dentryCacheSize = 0;
+}
+
+// 加载了新的目录树后，旧的工作目录已不存在，回到根目录
+Directory* FileSystemContext::enter(WorkDir& wd) {
+    if (wd.generation != treeGeneration) {
+        wd.dir = nullptr;
+        setWorkDir(wd, root.get());
+    }
+    return wd.dir;
+}
+
+void FileSystemContext::setWorkDir(WorkDir& wd, Directory* dir) {
+    if (wd.dir && wd.generation == treeGeneration) wd.dir->releaseWorkDir();
+    dir->retainWorkDir();
+    wd.dir = dir;
+    wd.generation = treeGeneration;
+}
+
+// 换上新的目录树后调用：旧树中的工作目录和打开的文件一律作废
+void FileSystemContext::resetSessions() {
+    ++treeGeneration;
+    current.dir = nullptr;
+    setWorkDir(current, root.get());
+    std::lock_guard<std::mutex> guard(locks->files);
+    locks->opened.clear();
+}
+
+bool FileSystemContext::isOpen(int inodeId) {
+    std::lock_guard<std::mutex> guard(locks->files);
+    return locks->opened.count(inodeId) != 0;
+}
+
+void FileSystemContext::attach(WorkDir& wd) {
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    setWorkDir(wd, root.get());
+}
+
+void FileSystemContext::detach(WorkDir& wd) {
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    if (wd.dir && wd.generation == treeGeneration) wd.dir->releaseWorkDir();
+    wd.dir = nullptr;
+}
+
+void FileSystemContext::mkdir(const std::string& path) { mkdir(current, path); }
+void FileSystemContext::cd(const std::string& path) { cd(current, path); }
+void FileSystemContext::ls(const std::string& path) { ls(current, path); }
+void FileSystemContext::createFile(const std::string& path, const std::string& content) {
+    createFile(current, path, content);
+}
+void FileSystemContext::readFile(const std::string& path, std::ostream& out) { readFile(current, path, out); }
+void FileSystemContext::streamFile(const std::string& path, const ChunkSink& sink) {
+    streamFile(current, path, sink);
+}
+void FileSystemContext::rm(const std::string& path) { rm(current, path); }
+void FileSystemContext::rmdir(const std::string& path) { rmdir(current, path); }
+void FileSystemContext::mv(const std::string& src, const std::string& dst) { mv(current, src, dst); }
+void FileSystemContext::appendFile(const std::string& path, const std::string& content) {
+    appendFile(current, path, content);
+}
+void FileSystemContext::overwriteFile(const std::string& path, const std::string& content) {
+    overwriteFile(current, path, content);
+}
+void FileSystemContext::truncate(const std::string& path, int size) { truncate(current, path, size); }
+void FileSystemContext::removeTree(const std::string& path) { removeTree(current, path); }
+void FileSystemContext::copy(const std::string& src, const std::string& dst) { copy(current, src, dst); }
+FileSystemContext::Usage FileSystemContext::du(const std::string& path) { return du(current, path); }
+void FileSystemContext::importTree(const std::string& hostDir, const std::string& path) {
+    importTree(current, hostDir, path);
+}
+void FileSystemContext::exportTree(const std::string& path, const std::string& hostDir) {
+    exportTree(current, path, hostDir);
+}
+
+void FileSystemContext::mkdir(WorkDir& wd, const std::string& path) {
+    Transaction tx(*this);
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    if (!traverse(enter(wd), path, true)) {
         std::cerr << "mkdir failed: invalid path " << path << std::endl;
     }
 }
 
-void FileSystemContext::cd(const std::string& path) {
-    Directory* dest = traverse(path);
+void FileSystemContext::cd(WorkDir& wd, const std::string& path) {
+    // 上下文自己的工作目录由所有线程共享，修改时独占目录树；会话的工作目录只属于一个线程
+    std::shared_mutex& treeLock = locks->tree;
+    std::unique_lock<std::shared_mutex> exclusive(treeLock, std::defer_lock);
+    std::shared_lock<std::shared_mutex> shared(treeLock, std::defer_lock);
+    if (&wd == &current) exclusive.lock();
+    else shared.lock();
+    Directory* dest = traverse(enter(wd), path);
     if (dest) {
-        current = dest;
+        setWorkDir(wd, dest);
     } else {
         std::cerr << "cd failed: path not found " << path << std::endl;
     }
 }
 
-std::string FileSystemContext::pwd()  {
-    return current->getPath();
+const std::string& FileSystemContext::pwd() const {
+    return current.dir->getPath();
 }
 
-void FileSystemContext::ls(const std::string& path) {
-    Directory* dir = path.empty() ? current : traverse(path);
+std::string FileSystemContext::pwd(WorkDir& wd) {
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    return enter(wd)->getPath();
+}
+
+void FileSystemContext::ls(WorkDir& wd, const std::string& path) {
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    Directory* cwd = enter(wd);
+    Directory* dir = path.empty() ? cwd : traverse(cwd, path);
     if (dir) {
+        std::shared_lock<std::shared_mutex> guard(dir->entryLock());
         dir->listContents();
     } else {
         std::cerr << "ls failed: path not found " << path << std::endl;
     }
 }
 
-void FileSystemContext::createFile(const std::string& name, const std::string& content) {
-    if (current->findFile(name) != -1) {
-        std::cerr << "createFile failed: file already exists" << std::endl;
+// 在父目录锁的保护下查找文件并锁住它的 inode（guard 为共享锁或独占锁）。
+// inode 锁在释放目录锁之前取得，因此其间文件不会被其他线程删除
+template <typename Guard>
+Inode* FileSystemContext::lockFile(Directory* dir, const std::string& name, Guard& guard) {
+    std::shared_lock<std::shared_mutex> dirGuard(dir->entryLock());
+    int inodeId = dir->findFile(name);
+    Inode* inode = inodeManager.getInode(inodeId);
+    if (!inode || inode->type != Inode::FILE) return nullptr;
+    std::shared_mutex& lock = inodeManager.inodeLock(inodeId);
+    if (!inode->blockMapCached()) {
+        // 块映射缓存在首次访问时展开，须独占 inode；之后的读者只读缓存
+        std::unique_lock<std::shared_mutex> priming(lock);
+        inode->getBlockMap(diskManager);
+    }
+    guard = Guard(lock);
+    return inode;
+}
+
+void FileSystemContext::createFile(WorkDir& wd, const std::string& path, const std::string& content) {
+    Transaction tx(*this);
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    std::string name;
+    Directory* dir = resolveParent(enter(wd), path, name);
+    if (!dir) {
+        std::cerr << "createFile failed: invalid path " << path << std::endl;
         return;
     }
+    auto exists = [&] { return dir->findFile(name) != -1; };
+    {
+        std::shared_lock<std::shared_mutex> guard(dir->entryLock());
+        if (exists()) {
+            std::cerr << "createFile failed: file already exists" << std::endl;
+            return;
+        }
+    }
+    // 新 inode 在挂入目录之前其他线程看不到，写入时不必加锁
     int newInode = inodeManager.allocateInode(Inode::FILE);
     Inode* inode = inodeManager.getInode(newInode);
-    if (!inode->writeData(diskManager, content.c_str(), content.size() + 1)) {
-        std::cerr << "createFile failed: write error" << std::endl;
+    int length = static_cast<int>(content.size()) + 1;
+    bool written = inode->write(diskManager, 0, length, content.c_str()) == length;
+
+    std::unique_lock<std::shared_mutex> guard(dir->entryLock());
+    if (!written || exists()) {
+        std::cerr << (written ? "createFile failed: file already exists" : "createFile failed: write error")
+                  << std::endl;
+        inode->clearData(diskManager);
         inodeManager.deleteInode(newInode);
         return;
     }
-    current->addFile(name, newInode);
+    dir->addFile(name, newInode);
+    recordLink(dir, name, newInode, DirEntry::FILE);
 }
 
-void FileSystemContext::readFile(const std::string& name){
-    int inodeId = current->findFile(name);
-    if (inodeId == -1) {
+void FileSystemContext::readFile(WorkDir& wd, const std::string& path, std::ostream& out) {
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    std::string name;
+    Directory* dir = resolveParent(enter(wd), path, name);
+    std::shared_lock<std::shared_mutex> reading;
+    Inode* inode = dir ? lockFile(dir, name, reading) : nullptr;
+    if (!inode) {
         std::cerr << "readFile failed: file not found" << std::endl;
         return;
     }
-    Inode* inode = inodeManager.getInode(inodeId);
+    // 按块流式输出，遇到结束符且后面还有内容就跳过
+    out << "File content of '" << name << "':\n";
+    int size = inode->size;
+    int pos = 0;
+    inode->readStream(diskManager, 0, size, [&](const char* data, int n) {
+        const char* end = data + n;
+        while (data < end) {
+            const char* nul = static_cast<const char*>(std::memchr(data, '\0', end - data));
+            if (!nul) nul = end;
+            out.write(data, nul - data);
+            pos += static_cast<int>(nul - data);
+            if (nul == end) break;
+            if (pos + 1 == size) out.put('\0');
+            ++pos;
+            data = nul + 1;
+        }
+    });
+    out << '\n';
+}
+
+void FileSystemContext::streamFile(WorkDir& wd, const std::string& path, const ChunkSink& sink) {
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    std::string name;
+    Directory* dir = resolveParent(enter(wd), path, name);
+    std::shared_lock<std::shared_mutex> reading;
+    Inode* inode = dir ? lockFile(dir, name, reading) : nullptr;
     if (!inode) {
-        std::cerr << "readFile failed: inode not found" << std::endl;
-        return;
-    }
-    char buffer[4096] = {0};
-    if (!inode->readData(diskManager, buffer, sizeof(buffer))) {
-        std::cerr << "readFile failed: read error" << std::endl;
+        std::cerr << "streamFile failed: file not found" << std::endl;
         return;
     }
-    // 逐字符打印buffer内容，遇到结束符且后面还有内容就跳过
-    std::cout << "File content of '" << name << "':" << std::endl;
-    for (int i = 0; i < inode->size && i < sizeof(buffer); ++i) {
-        if (buffer[i] == '\0' && i + 1 < inode->size) {
-            continue; // 跳过结束符后面的内容
-        }
-        std::cout << buffer[i];
-    }
-    std::cout << std::endl;
-
+    inode->readStream(diskManager, 0, inode->size, sink);
 }
 
-void FileSystemContext::rm(const std::string& name) {
-    int inodeId = current->findFile(name);
+void FileSystemContext::rm(WorkDir& wd, const std::string& path) {
+    Transaction tx(*this);
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    std::string name;
+    Directory* dir = resolveParent(enter(wd), path, name);
+    if (!dir) {
+        std::cerr << "rm failed: file not found" << std::endl;
+        return;
+    }
+    std::unique_lock<std::shared_mutex> guard(dir->entryLock());
+    int inodeId = dir->findFile(name);
     if (inodeId == -1) {
         std::cerr << "rm failed: file not found" << std::endl;
         return;
@@ -118,13 +306,27 @@ void FileSystemContext::rm(const std::string& name) {
         std::cerr << "rm failed: not a file" << std::endl;
         return;
     }
-    inode->clearData(diskManager); // 清除文件数据
-    inodeManager.deleteInode(inodeId);
-    current->removeFile(name);
+    {
+        // 等正在读写该文件的线程结束
+        std::unique_lock<std::shared_mutex> writing(inodeManager.inodeLock(inodeId));
+        if (isOpen(inodeId)) {
+            std::cerr << "rm failed: file is open" << std::endl;
+            return;
+        }
+        inode->clearData(diskManager); // 清除文件数据
+        inodeManager.deleteInode(inodeId);
+    }
+    dir->removeFile(name);
+    recordUnlink(dir, name, DirEntry::FILE);
 }
 
-void FileSystemContext::rmdir(const std::string& name) {
-    Directory* target = current->findSubdir(name);
+void FileSystemContext::rmdir(WorkDir& wd, const std::string& path) {
+    Transaction tx(*this);
+    // 删除目录会销毁 Directory 对象，独占整棵树
+    std::unique_lock<std::shared_mutex> tree(locks->tree);
+    std::string name;
+    Directory* parent = resolveParent(enter(wd), path, name);
+    Directory* target = parent ? parent->findSubdir(name) : nullptr;
     if (!target) {
         std::cerr << "rmdir failed: directory not found" << std::endl;
         return;
@@ -133,73 +335,1135 @@ void FileSystemContext::rmdir(const std::string& name) {
         std::cerr << "rmdir failed: invalid directory" << std::endl;
         return;
     }
-    std::string fullPath = target->getPath();
     if (!target->isDirEmpty()) {
         std::cerr << "rmdir failed: only empty directories can be removed" << std::endl;
         return;
     }
-    current->removeSubdir(name);
+    if (target->workDirRefs() > 0) {
+        std::cerr << "rmdir failed: directory is in use as a working directory" << std::endl;
+        return;
+    }
+    invalidateDentries(); // 缓存中可能有指向该目录的项
+    inodeManager.deleteInode(target->getInodeId());
+    parent->removeSubdir(name);
+    recordUnlink(parent, name, DirEntry::DIRECTORY);
 }
 
-void FileSystemContext::appendFile(const std::string& name, const std::string& content) {
-    int inodeId = current->findFile(name);
-    Inode* inode = inodeManager.getInode(inodeId);
-    if (inodeId == -1 || inode == nullptr) {
-        std::cerr << "appendFile failed: file not found or inode missing" << std::endl;
+void FileSystemContext::removeTree(WorkDir& wd, const std::string& path) {
+    Transaction tx(*this);
+    // 与 rmdir 相同，独占整棵树；其间没有其他操作在读写子树中的文件，不必再加 inode 锁
+    std::unique_lock<std::shared_mutex> tree(locks->tree);
+    std::string name;
+    Directory* parent = resolveParent(enter(wd), path, name);
+    Directory* target = parent ? parent->findSubdir(name) : nullptr;
+    if (!target) {
+        if (parent && parent->findFile(name) != -1) {
+            tree.unlock();
+            rm(wd, path);
+            return;
+        }
+        std::cerr << "rm failed: directory not found" << std::endl;
         return;
     }
-    if (!inode || inode->type != Inode::FILE) {
-        std::cerr << "appendFile failed: file not found or not a file" << std::endl;
+
+    // 一趟迭代遍历：检查子树中有没有工作目录和打开的文件，同时收集全部 inode；
+    // 检查不通过时什么也不改
+    std::vector<int> fileIds, dirIds;
+    std::vector<Directory*> pending{target};
+    {
+        std::lock_guard<std::mutex> files(locks->files);
+        while (!pending.empty()) {
+            Directory* dir = pending.back();
+            pending.pop_back();
+            if (dir->workDirRefs() > 0) {
+                std::cerr << "rm failed: directory is in use as a working directory" << std::endl;
+                return;
+            }
+            bool open = false;
+            dir->forEachFile([&](const DirEntry& entry) {
+                open = open || locks->opened.count(entry.inodeId) != 0;
+                fileIds.push_back(entry.inodeId);
+            });
+            if (open) {
+                std::cerr << "rm failed: file is open" << std::endl;
+                return;
+            }
+            dirIds.push_back(dir->getInodeId());
+            dir->forEachSubdir([&](Directory* sub) { pending.push_back(sub); });
+        }
+    }
+
+    // 数据块按 extent 整段释放，inode 一次取表锁全部释放
+    for (int id : fileIds) {
+        if (Inode* inode = inodeManager.getInode(id)) inode->clearData(diskManager);
+    }
+    fileIds.insert(fileIds.end(), dirIds.begin(), dirIds.end());
+    inodeManager.deleteInodes(fileIds);
+    invalidateDentries();
+
+    // 子树自底向上逐个摘下再销毁，很深的目录也不会递归析构
+    std::vector<std::unique_ptr<Directory>> doomed;
+    doomed.push_back(parent->detachSubdir(name));
+    std::vector<std::string> names;
+    while (!doomed.empty()) {
+        std::unique_ptr<Directory> dir = std::move(doomed.back());
+        doomed.pop_back();
+        names.clear();
+        dir->forEachSubdir([&](Directory* sub) { names.push_back(sub->getName()); });
+        for (const std::string& sub : names) doomed.push_back(dir->detachSubdir(sub));
+    }
+    recordUnlink(parent, name, DirEntry::DIRECTORY);
+}
+
+// 在 parent 下新建空目录 name，已有同名目录或文件时返回 nullptr
+Directory* FileSystemContext::makeSubdir(Directory* parent, const std::string& name) {
+    std::unique_lock<std::shared_mutex> guard(parent->entryLock());
+    if (parent->findSubdir(name) || parent->findFile(name) != -1) return nullptr;
+    int inodeId = inodeManager.allocateInode(Inode::DIRECTORY);
+    Directory* dir = parent->addSubdir(name, inodeId);
+    recordLink(parent, dir->getName(), inodeId, DirEntry::DIRECTORY);
+    return dir;
+}
+
+// 把 src 中的文件 name 复制为 dst 中的 newName，inodeId 为调用方分配好的新 inode，失败时由这里释放。
+// 新 inode 一次预留全部块，再按源文件的 extent 成段复制
+bool FileSystemContext::copyFile(Directory* src, const std::string& name, Directory* dst,
+                                 const std::string& newName, int inodeId) {
+    Inode* copy = inodeManager.getInode(inodeId);
+    bool ok;
+    {
+        std::shared_lock<std::shared_mutex> reading;
+        Inode* inode = lockFile(src, name, reading);
+        ok = inode && copy->truncate(diskManager, inode->size);
+        int offset = 0;
+        if (ok) {
+            inode->readStream(diskManager, 0, inode->size, [&](const char* data, int n) {
+                ok = ok && copy->write(diskManager, offset, n, data) == n;
+                offset += n;
+            });
+        }
+    }
+    if (ok) {
+        std::unique_lock<std::shared_mutex> guard(dst->entryLock());
+        ok = dst->findFile(newName) == -1 && !dst->findSubdir(newName);
+        if (ok) {
+            dst->addFile(newName, inodeId);
+            recordLink(dst, newName, inodeId, DirEntry::FILE);
+            inodeManager.markChanged(inodeId);
+        }
+    }
+    if (!ok) {
+        copy->clearData(diskManager);
+        inodeManager.deleteInode(inodeId);
+    }
+    return ok;
+}
+
+void FileSystemContext::copy(WorkDir& wd, const std::string& src, const std::string& dst) {
+    Transaction tx(*this);
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    Directory* cwd = enter(wd);
+    std::string srcName, dstName;
+    Directory* srcParent = resolveParent(cwd, src, srcName);
+    // 目标是已有的目录（含根目录）时复制到其中，沿用源的名字，否则按“父目录/新名字”处理
+    Directory* dstParent = traverse(cwd, dst);
+    if (dstParent) {
+        dstName = srcName;
+    } else {
+        dstParent = resolveParent(cwd, dst, dstName);
+    }
+    if (!srcParent || !dstParent) {
+        std::cerr << "cp failed: path not found" << std::endl;
         return;
     }
-    char buffer[4096] = {0};
-    if (inode->readData(diskManager, buffer, sizeof(buffer))) {
-        std::string fullData(buffer, inode->size); // 用 size 显式构造
-        fullData += content;
-        inode->writeData(diskManager, fullData.c_str(), fullData.size() + 1);
+    Directory* srcDir;
+    int srcFile;
+    {
+        std::shared_lock<std::shared_mutex> guard(srcParent->entryLock());
+        srcDir = srcParent->findSubdir(srcName);
+        srcFile = srcDir ? -1 : srcParent->findFile(srcName);
+    }
+    if (!srcDir) {
+        if (srcFile == -1 || !copyFile(srcParent, srcName, dstParent, dstName,
+                                       inodeManager.allocateInode(Inode::FILE))) {
+            std::cerr << "cp failed: " << (srcFile == -1 ? "source not found" : "destination exists or disk full")
+                      << std::endl;
+        }
+        return;
+    }
+    if (srcDir->isAncestorOf(dstParent)) {
+        std::cerr << "cp failed: cannot copy a directory into itself" << std::endl;
+        return;
+    }
+    Directory* top = makeSubdir(dstParent, dstName);
+    if (!top) {
+        std::cerr << "cp failed: destination already exists" << std::endl;
+        return;
+    }
+
+    // 一趟迭代遍历源目录树；删除和移动目录须独占目录树，遍历期间源树的形状不变
+    std::vector<std::pair<Directory*, Directory*>> pending{{srcDir, top}};
+    std::vector<std::string> names;
+    std::vector<Directory*> subdirs;
+    std::vector<int> ids;
+    while (!pending.empty()) {
+        auto [from, to] = pending.back();
+        pending.pop_back();
+        names.clear();
+        subdirs.clear();
+        {
+            std::shared_lock<std::shared_mutex> guard(from->entryLock());
+            from->forEachFile([&](const DirEntry& entry) { names.push_back(entry.name); });
+            from->forEachSubdir([&](Directory* sub) { subdirs.push_back(sub); });
+        }
+        // 同一目录中文件的 inode 一次分配
+        ids.clear();
+        inodeManager.allocateInodes(Inode::FILE, static_cast<int>(names.size()), ids);
+        for (size_t i = 0; i < names.size(); ++i) {
+            if (!copyFile(from, names[i], to, names[i], ids[i])) {
+                ids.erase(ids.begin(), ids.begin() + i + 1);
+                inodeManager.deleteInodes(ids);
+                std::cerr << "cp failed: cannot copy " << from->getPath() << "/" << names[i] << std::endl;
+                return;
+            }
+        }
+        for (Directory* sub : subdirs) {
+            if (Directory* made = makeSubdir(to, sub->getName())) pending.emplace_back(sub, made);
+        }
+    }
+}
+
+FileSystemContext::Usage FileSystemContext::du(WorkDir& wd, const std::string& path) {
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    Directory* cwd = enter(wd);
+    Directory* top = path.empty() ? cwd : traverse(cwd, path);
+    Usage usage;
+    auto addFile = [&](int inodeId) {
+        std::shared_lock<std::shared_mutex> reading(inodeManager.inodeLock(inodeId));
+        if (Inode* inode = inodeManager.getInode(inodeId)) {
+            usage.bytes += inode->size;
+            usage.blocks += inode->blockCount;
+            ++usage.files;
+        }
+    };
+    if (!top) {
+        std::string name;
+        Directory* parent = resolveParent(cwd, path, name);
+        int inodeId = -1;
+        if (parent) {
+            std::shared_lock<std::shared_mutex> guard(parent->entryLock());
+            inodeId = parent->findFile(name);
+        }
+        if (inodeId == -1) {
+            std::cerr << "du failed: path not found " << path << std::endl;
+            return usage;
+        }
+        addFile(inodeId);
+        return usage;
+    }
+    // 一趟迭代遍历，每个目录只在列出子项时持有目录锁
+    std::vector<Directory*> pending{top};
+    std::vector<int> ids;
+    while (!pending.empty()) {
+        Directory* dir = pending.back();
+        pending.pop_back();
+        ++usage.dirs;
+        ids.clear();
+        {
+            std::shared_lock<std::shared_mutex> guard(dir->entryLock());
+            dir->forEachFile([&](const DirEntry& entry) { ids.push_back(entry.inodeId); });
+            dir->forEachSubdir([&](Directory* sub) { pending.push_back(sub); });
+        }
+        for (int id : ids) addFile(id);
+    }
+    return usage;
+}
+
+Directory* FileSystemContext::resolveParent(Directory* cwd, const std::string& path, std::string& name) {
+    size_t end = path.find_last_not_of('/');
+    if (end == std::string::npos) return nullptr; // 空路径或根目录
+    size_t slash = path.rfind('/', end);
+    name = path.substr(slash == std::string::npos ? 0 : slash + 1,
+                       end - (slash == std::string::npos ? 0 : slash + 1) + 1);
+    if (slash == std::string::npos) return cwd;
+    if (slash == 0) return root.get();
+    return traverse(cwd, path.substr(0, slash));
+}
+
+void FileSystemContext::mv(WorkDir& wd, const std::string& src, const std::string& dst) {
+    Transaction tx(*this);
+    // 移动文件只改两个目录的文件项；移动目录会改变整棵子树的路径，独占整棵树
+    {
+        std::shared_lock<std::shared_mutex> tree(locks->tree);
+        if (moveFile(enter(wd), src, dst)) return;
+    }
+    std::unique_lock<std::shared_mutex> tree(locks->tree);
+    moveEntry(enter(wd), src, dst);
+}
+
+// 源是文件时在共享目录树锁下完成移动并返回 true；源是目录或不存在时返回 false
+bool FileSystemContext::moveFile(Directory* cwd, const std::string& src, const std::string& dst) {
+    std::string srcName;
+    Directory* srcParent = resolveParent(cwd, src, srcName);
+    if (!srcParent) return false;
+    {
+        std::shared_lock<std::shared_mutex> guard(srcParent->entryLock());
+        if (srcParent->findSubdir(srcName) || srcParent->findFile(srcName) == -1) return false;
+    }
+
+    // 目标是已存在的目录时移入其中，否则按“父目录/新名字”处理
+    std::string dstName = srcName;
+    Directory* dstParent = traverse(cwd, dst);
+    if (!dstParent) dstParent = resolveParent(cwd, dst, dstName);
+    if (!dstParent) {
+        std::cerr << "mv failed: invalid destination " << dst << std::endl;
+        return true;
+    }
+
+    // 两个目录按 inode 号从小到大加锁
+    Directory* first = srcParent;
+    Directory* second = dstParent;
+    if (second->getInodeId() < first->getInodeId()) std::swap(first, second);
+    std::unique_lock<std::shared_mutex> firstGuard(first->entryLock());
+    std::unique_lock<std::shared_mutex> secondGuard;
+    if (second != first) secondGuard = std::unique_lock<std::shared_mutex>(second->entryLock());
+
+    int fileInode = srcParent->findFile(srcName); // 加锁前可能已被其他线程删除
+    if (fileInode == -1) {
+        std::cerr << "mv failed: source not found " << src << std::endl;
+        return true;
+    }
+    if (dstParent->findFile(dstName) != -1) {
+        std::cerr << "mv failed: destination already exists" << std::endl;
+        return true;
+    }
+    srcParent->removeFile(srcName);
+    dstParent->addFile(dstName, fileInode);
+    recordUnlink(srcParent, srcName, DirEntry::FILE);
+    recordLink(dstParent, dstName, fileInode, DirEntry::FILE);
+    return true;
+}
+
+// 独占目录树锁时移动文件或目录
+bool FileSystemContext::moveEntry(Directory* cwd, const std::string& src, const std::string& dst) {
+    std::string srcName;
+    Directory* srcParent = resolveParent(cwd, src, srcName);
+    Directory* moving = srcParent ? srcParent->findSubdir(srcName) : nullptr;
+    int fileInode = (srcParent && !moving) ? srcParent->findFile(srcName) : -1;
+    if (!moving && fileInode == -1) {
+        std::cerr << "mv failed: source not found " << src << std::endl;
+        return false;
+    }
+
+    // 目标是已存在的目录时移入其中，否则按“父目录/新名字”处理
+    std::string dstName;
+    Directory* dstParent = traverse(cwd, dst);
+    if (dstParent) {
+        dstName = srcName;
+    } else {
+        dstParent = resolveParent(cwd, dst, dstName);
+        if (!dstParent) {
+            std::cerr << "mv failed: invalid destination " << dst << std::endl;
+            return false;
+        }
+    }
+
+    if (moving) {
+        if (moving->isAncestorOf(dstParent)) {
+            std::cerr << "mv failed: cannot move a directory into itself" << std::endl;
+            return false;
+        }
+        if (dstParent->findSubdir(dstName)) {
+            std::cerr << "mv failed: destination already exists" << std::endl;
+            return false;
+        }
+        invalidateDentries(); // 子树中所有目录的路径都变了
+        dstParent->attachSubdir(srcParent->detachSubdir(srcName), dstName);
+        recordUnlink(srcParent, srcName, DirEntry::DIRECTORY);
+        recordLink(dstParent, dstName, moving->getInodeId(), DirEntry::DIRECTORY);
     } else {
-        std::cerr << "appendFile failed: read error" << std::endl;
+        if (dstParent->findFile(dstName) != -1) {
+            std::cerr << "mv failed: destination already exists" << std::endl;
+            return false;
+        }
+        srcParent->removeFile(srcName);
+        dstParent->addFile(dstName, fileInode);
+        recordUnlink(srcParent, srcName, DirEntry::FILE);
+        recordLink(dstParent, dstName, fileInode, DirEntry::FILE);
     }
+    return true;
 }
 
-void FileSystemContext::overwriteFile(const std::string& name, const std::string& content) {
-    int inodeId = current->findFile(name);
-    Inode* inode = inodeManager.getInode(inodeId);
-    if (inodeId == -1 || inode == nullptr) {
-        std::cerr << "appendFile failed: file not found or inode missing" << std::endl;
+void FileSystemContext::appendFile(WorkDir& wd, const std::string& path, const std::string& content) {
+    Transaction tx(*this);
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    std::string name;
+    Directory* dir = resolveParent(enter(wd), path, name);
+    std::unique_lock<std::shared_mutex> writing;
+    Inode* inode = dir ? lockFile(dir, name, writing) : nullptr;
+    if (!inode) {
+        std::cerr << "appendFile failed: file not found or not a file" << std::endl;
         return;
     }
-    if (!inode || inode->type != Inode::FILE) {
+    inodeManager.markChanged(inode->inodeId);
+    // 新内容覆盖原来末尾的结束符，只写入追加部分
+    int offset = inode->size;
+    char last = 1;
+    if (offset > 0 && inode->read(diskManager, offset - 1, 1, &last) == 1 && last == '\0') {
+        --offset;
+    }
+    int length = static_cast<int>(content.size()) + 1;
+    if (inode->write(diskManager, offset, length, content.c_str()) != length) {
+        std::cerr << "appendFile failed: write error" << std::endl;
+    }
+}
+
+void FileSystemContext::overwriteFile(WorkDir& wd, const std::string& path, const std::string& content) {
+    Transaction tx(*this);
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    std::string name;
+    Directory* dir = resolveParent(enter(wd), path, name);
+    std::unique_lock<std::shared_mutex> writing;
+    Inode* inode = dir ? lockFile(dir, name, writing) : nullptr;
+    if (!inode) {
         std::cerr << "overwriteFile failed: file not found or not a file" << std::endl;
         return;
     }
-    for (int i = 0; i < inode->blockCount; ++i) {
-        diskManager.freeBlock(inode->directBlocks[i]);
+    inodeManager.markChanged(inode->inodeId);
+    // 原地改写已有的块，只为长度差分配或释放块
+    if (!inode->writeData(diskManager, content.c_str(), static_cast<int>(content.size()) + 1)) {
+        std::cerr << "overwriteFile failed: write error" << std::endl;
+    }
+}
+
+void FileSystemContext::truncate(WorkDir& wd, const std::string& path, int size) {
+    Transaction tx(*this);
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    std::string name;
+    Directory* dir = resolveParent(enter(wd), path, name);
+    std::unique_lock<std::shared_mutex> writing;
+    Inode* inode = dir ? lockFile(dir, name, writing) : nullptr;
+    if (!inode) {
+        std::cerr << "truncate failed: file not found or not a file" << std::endl;
+        return;
+    }
+    inodeManager.markChanged(inode->inodeId);
+    if (!inode->truncate(diskManager, size)) {
+        std::cerr << "truncate failed: invalid size " << size << std::endl;
     }
-    inode->blockCount = 0;
-    inode->writeData(diskManager, content.c_str(), content.size() + 1);
+}
+
+void FileSystemContext::importTree(WorkDir& wd, const std::string& hostDir, const std::string& path) {
+    namespace hostfs = std::filesystem;
+    // 先遍历宿主目录树：目录排在其内容之前，文件记下长度交给读取流水线
+    struct HostEntry {
+        std::string rel;     // 相对 hostDir 的路径，也是在 path 下的路径
+        int file;            // 在读取流水线中的下标，目录为 -1
+        int size;
+    };
+    std::vector<HostEntry> entries;
+    std::vector<std::string> paths;
+    std::vector<uint64_t> sizes;
+    std::error_code ec;
+    if (!hostfs::is_directory(hostDir, ec)) {
+        std::cerr << "import failed: host directory not found " << hostDir << std::endl;
+        return;
+    }
+    const uint64_t maxSize = std::min<uint64_t>(INT_MAX, static_cast<uint64_t>(Inode::MAX_BLOCKS) * DiskManager::BLOCK_SIZE);
+    hostfs::recursive_directory_iterator it(hostDir, hostfs::directory_options::skip_permission_denied, ec), end;
+    for (; !ec && it != end; it.increment(ec)) {
+        std::string rel = it->path().lexically_relative(hostDir).generic_string();
+        if (it->is_directory(ec)) {
+            entries.push_back(HostEntry{rel, -1, 0});
+        } else if (it->is_regular_file(ec)) {
+            uint64_t size = it->file_size(ec);
+            if (ec || size > maxSize) {
+                std::cerr << "import: skipped " << rel << (ec ? ": cannot stat" : ": file too large") << std::endl;
+                ec.clear();
+                continue;
+            }
+            entries.push_back(HostEntry{rel, static_cast<int>(paths.size()), static_cast<int>(size)});
+            paths.push_back(it->path().string());
+            sizes.push_back(size);
+        }
+    }
+    if (ec) {
+        std::cerr << "import failed: cannot read " << hostDir << ": " << ec.message() << std::endl;
+        return;
+    }
+
+    // 读线程预读后面的文件，本线程同时把已读出的块写入虚拟磁盘
+    HostReader reader(std::move(paths), std::move(sizes));
+    HostReader::Chunk chunk;
+    int files = 0, dirs = 0;
+    uint64_t bytes = 0;
+    bool full = false;
+    std::vector<int> ids;
+    size_t next = 0;
+    while (next < entries.size() && !full) {
+        // 每组至多 IMPORT_GROUP_FILES 个文件或 IMPORT_GROUP_BYTES 字节，作为一个日志批次提交；
+        // 组内文件的 inode 一次分配
+        size_t groupEnd = next;
+        int groupFiles = 0;
+        uint64_t groupBytes = 0;
+        while (groupEnd < entries.size() && groupFiles < IMPORT_GROUP_FILES && groupBytes < IMPORT_GROUP_BYTES) {
+            if (entries[groupEnd].file >= 0) {
+                ++groupFiles;
+                groupBytes += entries[groupEnd].size;
+            }
+            ++groupEnd;
+        }
+        Transaction tx(*this);
+        std::shared_lock<std::shared_mutex> tree(locks->tree);
+        Directory* base = traverse(enter(wd), path, true);
+        if (!base) {
+            std::cerr << "import failed: invalid path " << path << std::endl;
+            return;
+        }
+        ids.clear();
+        inodeManager.allocateInodes(Inode::FILE, groupFiles, ids);
+        size_t used = 0;
+        for (; next < groupEnd && !full; ++next) {
+            const HostEntry& e = entries[next];
+            if (e.file < 0) {
+                if (traverse(base, e.rel, true)) ++dirs;
+                continue;
+            }
+            std::string name;
+            Directory* dir = resolveParent(base, e.rel, name);
+            auto exists = [&] { return dir->findFile(name) != -1; };
+            bool ok = dir != nullptr;
+            if (ok) {
+                std::shared_lock<std::shared_mutex> guard(dir->entryLock());
+                ok = !exists();
+            }
+            if (!ok) std::cerr << "import: skipped " << e.rel << (dir ? ": file already exists" : ": invalid path") << std::endl;
+
+            // 新 inode 在挂入目录之前其他线程看不到；整个文件的块一次预留，随后按块写入
+            int inodeId = ids[used++];
+            Inode* inode = inodeManager.getInode(inodeId);
+            if (ok && !inode->truncate(diskManager, e.size)) full = true;
+            bool failed = false;
+            do {
+                if (full || !reader.next(chunk)) {
+                    failed = true;
+                    break;
+                }
+                int n = static_cast<int>(chunk.data.size());
+                if (chunk.failed) {
+                    std::cerr << "import: skipped " << e.rel << ": read error" << std::endl;
+                    failed = true;
+                } else if (ok && n > 0 &&
+                           inode->write(diskManager, static_cast<int>(chunk.offset), n, chunk.data.data()) != n) {
+                    full = true;
+                }
+            } while (!chunk.last);
+
+            if (ok && !failed && !full) {
+                std::unique_lock<std::shared_mutex> guard(dir->entryLock());
+                if (exists()) {
+                    std::cerr << "import: skipped " << e.rel << ": file already exists" << std::endl;
+                    failed = true;
+                } else {
+                    dir->addFile(name, inodeId);
+                    recordLink(dir, name, inodeId, DirEntry::FILE);
+                    inodeManager.markChanged(inodeId);
+                    ++files;
+                    bytes += e.size;
+                }
+            } else {
+                failed = true;
+            }
+            if (failed) {
+                inode->clearData(diskManager);
+                inodeManager.deleteInode(inodeId);
+            }
+        }
+        // 中途停止时归还本组未用到的 inode
+        for (; used < ids.size(); ++used) inodeManager.deleteInode(ids[used]);
+    }
+    if (full) {
+        reader.stop();
+        std::cerr << "import failed: disk full" << std::endl;
+    }
+    std::cout << "Imported " << files << " files and " << dirs << " directories (" << bytes
+              << " bytes) from " << hostDir << '\n';
+}
+
+namespace {
+
+// 导出时目录项名字直接成为宿主路径的一段：空名字、. 、.. 和含 / 的名字会写到目标目录之外，一律跳过
+bool safeHostName(const std::string& name) {
+    return !name.empty() && name != "." && name != ".." && name.find('/') == std::string::npos;
+}
+
+// 写出全部内容；被信号打断时重试
+bool writeAll(int fd, const char* data, size_t n) {
+    while (n > 0) {
+        ssize_t w = ::write(fd, data, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return false;
+        data += w;
+        n -= static_cast<size_t>(w);
+    }
+    return true;
+}
+
+} // namespace
+
+void FileSystemContext::exportTree(WorkDir& wd, const std::string& path, const std::string& hostDir) {
+    namespace hostfs = std::filesystem;
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    Directory* cwd = enter(wd);
+    Directory* top = path.empty() ? cwd : traverse(cwd, path);
+    if (!top) {
+        std::cerr << "export failed: directory not found " << path << std::endl;
+        return;
+    }
+    // 持有目录树的共享锁，子目录不会被删除；目录锁只在列出子项时持有，文件按块流式写出
+    int files = 0;
+    uint64_t bytes = 0;
+    std::vector<std::pair<Directory*, hostfs::path>> pending{{top, hostfs::path(hostDir)}};
+    std::vector<std::string> names;
+    while (!pending.empty()) {
+        auto [dir, target] = std::move(pending.back());
+        pending.pop_back();
+        std::error_code ec;
+        hostfs::create_directories(target, ec);
+        if (ec) {
+            std::cerr << "export failed: cannot create " << target.string() << std::endl;
+            return;
+        }
+        names.clear();
+        {
+            std::shared_lock<std::shared_mutex> guard(dir->entryLock());
+            dir->forEachFile([&](const DirEntry& entry) { names.push_back(entry.name); });
+            dir->forEachSubdir([&](Directory* sub) {
+                if (safeHostName(sub->getName())) pending.emplace_back(sub, target / sub->getName());
+                else std::cerr << "export: skipped unsafe name " << dir->getPath() << "/" << sub->getName() << std::endl;
+            });
+        }
+        for (const std::string& name : names) {
+            if (!safeHostName(name)) {
+                std::cerr << "export: skipped unsafe name " << dir->getPath() << "/" << name << std::endl;
+                continue;
+            }
+            std::shared_lock<std::shared_mutex> reading;
+            Inode* inode = lockFile(dir, name, reading);
+            if (!inode) continue;   // 已被其他线程删除
+            std::string out = (target / name).string();
+            int fd = ::open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            bool written = fd >= 0;
+            inode->readStream(diskManager, 0, inode->size, [&](const char* data, int n) {
+                written = written && writeAll(fd, data, static_cast<size_t>(n));
+            });
+            if (fd >= 0 && ::close(fd) != 0) written = false;
+            if (!written) {
+                std::cerr << "export failed: cannot write " << out << std::endl;
+                return;
+            }
+            ++files;
+            bytes += inode->size;
+        }
+    }
+    std::cout << "Exported " << files << " files (" << bytes << " bytes) to " << hostDir << '\n';
+}
+
+// 打开计数在持有 inode 锁时增加，与 rm 的检查互斥
+bool FileSystemContext::open(WorkDir& wd, const std::string& path, OpenFile& file) {
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    std::string name;
+    Directory* dir = resolveParent(enter(wd), path, name);
+    std::shared_lock<std::shared_mutex> reading;
+    Inode* inode = dir ? lockFile(dir, name, reading) : nullptr;
+    if (!inode) {
+        std::cerr << "open failed: file not found or not a file" << std::endl;
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> guard(locks->files);
+        ++locks->opened[inode->inodeId];
+    }
+    file.inode = inode;
+    file.offset = 0;
+    file.generation = treeGeneration;
+    return true;
+}
+
+void FileSystemContext::close(OpenFile& file) {
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    if (file.inode && file.generation == treeGeneration) {
+        std::lock_guard<std::mutex> guard(locks->files);
+        auto it = locks->opened.find(file.inode->inodeId);
+        if (it != locks->opened.end() && --it->second == 0) locks->opened.erase(it);
+    }
+    file = OpenFile();
+}
+
+int FileSystemContext::read(OpenFile& file, char* buffer, int length) {
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    if (file.generation != treeGeneration) {
+        std::cerr << "read failed: file was closed by a reload" << std::endl;
+        return -1;
+    }
+    std::shared_lock<std::shared_mutex> reading(inodeManager.inodeLock(file.inode->inodeId));
+    int n = file.inode->read(diskManager, file.offset, length, buffer);
+    file.offset += n;
+    return n;
+}
+
+int FileSystemContext::write(OpenFile& file, const char* data, int length) {
+    Transaction tx(*this);
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    if (file.generation != treeGeneration) {
+        std::cerr << "write failed: file was closed by a reload" << std::endl;
+        return -1;
+    }
+    std::unique_lock<std::shared_mutex> writing(inodeManager.inodeLock(file.inode->inodeId));
+    inodeManager.markChanged(file.inode->inodeId);
+    int n = file.inode->write(diskManager, file.offset, length, data);
+    if (n < 0) {
+        std::cerr << "write failed: write error" << std::endl;
+        return -1;
+    }
+    file.offset += n;
+    return n;
 }
 
 void FileSystemContext::save(const std::string& filename){
-    diskManager.saveDisk(filename);
-    std::ofstream meta(filename + ".meta", std::ios::binary);
-    inodeManager.serialize(meta);
-    root->serialize(meta);
-    meta.close();
-    std::cout << "Disk saved to " << filename << std::endl;
+    ExclusiveBatch exclusive(*this);
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    if (!checkpoint(filename)) {
+        std::cerr << "Failed to save disk: " << filename << std::endl;
+        return;
+    }
+    std::cout << "Disk saved to " << filename << '\n';
 }
 
+// 检查点：镜像与元数据都落盘后清空日志。内存模式下保存到哪个文件，此后的修改就记入哪个文件的日志；
+// 已打开镜像时另存为其他文件只是复制，日志仍属于打开的镜像。
+// 日志覆盖了上次检查点以来的全部修改时，只原地写回脏块和脏 inode 槽位：中途崩溃也能由日志重做。
+// 否则（或增量写回失败时）整体写临时文件后改名
+bool FileSystemContext::checkpoint(const std::string& filename) {
+    bool incremental = journal.isOpen() && filename == imageName && commitJournal();
+    std::string metaPath = filename + ".meta";
+    int blocks = diskManager.getBlockCount();
+    bool ok = (incremental && diskManager.sync()) || diskManager.saveDisk(filename);
+    if (ok) {
+        ok = (incremental && metadata::update(metaPath, inodeManager, namespaceDirty ? root.get() : nullptr,
+                                              DiskManager::BLOCK_SIZE, blocks, journal.lastSeq())) ||
+             metadata::save(metaPath, inodeManager, *root, DiskManager::BLOCK_SIZE, blocks, journal.lastSeq());
+    }
+    if (!ok) return false;
+    if (!diskManager.imageFile().empty() && filename != diskManager.imageFile()) return true;
+
+    ok = (journal.isOpen() && filename == imageName) ? journal.reset()
+                                                    : journal.open(filename + ".journal", journal.lastSeq());
+    imageName = filename;
+    inodeManager.clearChanges();
+    inodeManager.clearDirty();
+    diskManager.clearChanges();
+    namespaceDirty = false;
+    return ok;
+}
+
+// 加载和打开镜像时先在临时对象中读入磁盘和元数据，全部成功后才关闭原来的日志、丢弃快照并替换；
+// 任何一步失败时原来的文件系统连同它的日志保持不变，之后的修改仍然记入日志
 void FileSystemContext::load(const std::string& filename) {
-    diskManager.loadDisk(filename);
-    std::ifstream meta(filename + ".meta", std::ios::binary);
-    if (!meta) {
-        std::cerr << "Failed to load metadata: " << filename << ".meta" << std::endl;
-        return;
-    }
-    inodeManager.deserialize(meta);
-    root = std::make_unique<Directory>("/", 0);
-    root->deserialize(meta);
-    current = root.get();
-    meta.close();
-    std::cout << "Disk loaded from " << filename << std::endl;
+    ExclusiveBatch exclusive(*this);
+    std::unique_lock<std::shared_mutex> tree(locks->tree);
+    Journal::Contents log = Journal::read(filename + ".journal");
+    if (!Journal::applyToImage(log, filename)) {
+        std::cerr << "Failed to replay journal: " << filename << ".journal" << std::endl;
+        return;
+    }
+    DiskManager disk;
+    if (!disk.loadDisk(filename)) {
+        std::cerr << "Failed to load disk image: " << filename << std::endl;
+        return;
+    }
+    if (replaceImage(filename, disk, log, false)) {
+        std::cout << "Disk loaded from " << filename << '\n';
+    }
+}
+
+void FileSystemContext::mount(const std::string& filename, int cacheBlocks) {
+    ExclusiveBatch exclusive(*this);
+    std::unique_lock<std::shared_mutex> tree(locks->tree);
+    // 先把日志中的块改动写回镜像文件，再打开镜像
+    Journal::Contents log = Journal::read(filename + ".journal");
+    if (!Journal::applyToImage(log, filename)) {
+        std::cerr << "Failed to replay journal: " << filename << ".journal" << std::endl;
+        return;
+    }
+    DiskManager disk;
+    bool opened = cacheBlocks > 0 ? disk.openCached(filename, cacheBlocks) : disk.mapDisk(filename);
+    if (!opened) {
+        std::cerr << "Failed to open disk image: " << filename << std::endl;
+        return;
+    }
+    bool fresh = !std::ifstream(filename + ".meta", std::ios::binary);
+    if (replaceImage(filename, disk, log, true)) {
+        std::cout << "Disk opened from " << filename << (fresh ? " (new file system)\n" : "\n");
+    }
+}
+
+// 快照记录的是当时的元数据，块数据留在原处：每个用到的块（含间接块）只加一次引用，
+// 之后当前文件系统写这些块时先复制（见 Inode::unshareBlocks），快照中的内容因此保持不变
+void FileSystemContext::snapshot(const std::string& name) {
+    ExclusiveBatch exclusive(*this);
+    std::unique_lock<std::shared_mutex> tree(locks->tree);
+    if (snapshots.count(name)) {
+        std::cerr << "snapshot failed: snapshot already exists" << std::endl;
+        return;
+    }
+    Snapshot snap;
+    snap.nextInodeId = inodeManager.highWater();
+    inodeManager.packTable(snap.inodes, snap.nextInodeId);
+    root->packTree(snap.dirs, snap.entries, snap.strings);
+    std::vector<int> blocks;
+    collectBlocks(snap.inodes, blocks);
+    for (int blk : blocks) diskManager.shareBlock(blk);
+    snapshots.emplace(name, std::move(snap));
+}
+
+// 回滚：当前文件系统的块先全部释放（快照引用的块只转为由快照保留），再重新使用快照中的块，
+// 然后换上快照的 inode 表和目录树。整个替换作为一个日志批次提交：两个表中出现过的 inode
+// 和上次检查点以来写过的槽位都记为改动，目录树记一条 TREE 记录
+void FileSystemContext::rollback(const std::string& name) {
+    ExclusiveBatch exclusive(*this);
+    std::unique_lock<std::shared_mutex> tree(locks->tree);
+    auto it = snapshots.find(name);
+    if (it == snapshots.end()) {
+        std::cerr << "rollback failed: snapshot not found" << std::endl;
+        return;
+    }
+    const Snapshot& snap = it->second;
+    if (journal.isOpen()) commitJournal();   // 先提交此前的修改，回滚单独成为一个批次
+
+    std::vector<char> current;
+    inodeManager.packTable(current, inodeManager.highWater());
+    std::vector<int> blocks;
+    collectBlocks(current, blocks);
+    for (int blk : blocks) diskManager.freeBlock(blk);
+    blocks.clear();
+    collectBlocks(snap.inodes, blocks);
+    for (int blk : blocks) diskManager.adoptBlock(blk);
+
+    // 高水位取两者中较大的，使旧表中的 id 都能记为已释放
+    int nextId = std::max(snap.nextInodeId, inodeManager.highWater());
+    InodeManager table;
+    table.unpackTable(snap.inodes.data(), snap.inodes.size() / Inode::RECORD_SIZE, nextId);
+    auto markLive = [&](const std::vector<char>& records) {
+        for (size_t off = 0; off + Inode::RECORD_SIZE <= records.size(); off += Inode::RECORD_SIZE) {
+            int id = static_cast<int32_t>(metadata::getU32(records.data() + off));
+            if (id > 0) table.markChanged(id);
+        }
+    };
+    markLive(current);
+    markLive(snap.inodes);
+    for (int id : inodeManager.dirtySlots()) table.markChanged(id);
+    std::unique_ptr<Directory> restored = Directory::unpackTree(
+        snap.dirs.data(), snap.dirs.size() / metadata::DIR_RECORD_SIZE,
+        snap.entries.data(), snap.entries.size() / metadata::ENTRY_RECORD_SIZE, snap.strings);
+
+    invalidateDentries();
+    inodeManager = std::move(table);
+    root = std::move(restored);
+    resetSessions();
+    namespaceDirty = true;
+    if (journal.isOpen()) {
+        journal.logTree(snap.dirs, snap.entries, snap.strings);
+        commitJournal();
+    }
+    std::cout << "Rolled back to snapshot " << name << '\n';
+}
+
+void FileSystemContext::deleteSnapshot(const std::string& name) {
+    ExclusiveBatch exclusive(*this);
+    std::unique_lock<std::shared_mutex> tree(locks->tree);
+    auto it = snapshots.find(name);
+    if (it == snapshots.end()) {
+        std::cerr << "delete snapshot failed: snapshot not found" << std::endl;
+        return;
+    }
+    std::vector<int> blocks;
+    collectBlocks(it->second.inodes, blocks);
+    for (int blk : blocks) diskManager.unshareBlock(blk);
+    snapshots.erase(it);
+}
+
+std::vector<std::string> FileSystemContext::listSnapshots() {
+    std::shared_lock<std::shared_mutex> tree(locks->tree);
+    std::vector<std::string> names;
+    for (const auto& entry : snapshots) names.push_back(entry.first);
+    return names;
+}
+
+void FileSystemContext::collectBlocks(const std::vector<char>& records, std::vector<int>& blocks) {
+    Inode node;
+    for (size_t off = 0; off + Inode::RECORD_SIZE <= records.size(); off += Inode::RECORD_SIZE) {
+        const char* rec = records.data() + off;
+        if (metadata::getU32(rec) == 0) continue;   // 空闲槽位
+        node.decode(rec);
+        node.collectBlocks(diskManager, blocks);
+    }
+}
+
+// 元数据不存在时：allowNew 为 true 则从空文件系统开始（新建的镜像，日志中若有记录则在其上回放），否则失败。
+// 元数据损坏或与磁盘参数不符时 metadata::load 抛出异常，这里报告后返回 false
+bool FileSystemContext::replaceImage(const std::string& filename, DiskManager& disk,
+                                     const Journal::Contents& log, bool allowNew) {
+    InodeManager table;
+    std::unique_ptr<Directory> tree;
+    uint64_t appliedSeq = 0;
+    try {
+        if (!metadata::load(filename + ".meta", table, tree, DiskManager::BLOCK_SIZE, disk.getBlockCount(),
+                            appliedSeq)) {
+            if (!allowNew) {
+                std::cerr << "Failed to load metadata: " << filename << ".meta" << std::endl;
+                return false;
+            }
+            tree = std::make_unique<Directory>("", table.allocateInode(Inode::DIRECTORY), nullptr);
+        }
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Failed to load metadata: " << filename << ".meta (" << e.what() << ")" << std::endl;
+        return false;
+    }
+
+    journal.close();
+    snapshots.clear();   // 快照的块引用计数随原来的磁盘一起丢弃
+    disk.setSecureErase(diskManager.secureErase());
+    diskManager = std::move(disk);
+    inodeManager = std::move(table);
+    root = std::move(tree);
+    invalidateDentries();
+    resetSessions();
+    return recover(filename, log, appliedSeq);
+}
+
+// 在已载入的元数据上回放日志，把结果写回元数据文件，然后清空日志并开始记录
+bool FileSystemContext::recover(const std::string& filename, const Journal::Contents& log, uint64_t appliedSeq) {
+    uint64_t seq = std::max(log.lastSeq, appliedSeq);
+    if (!log.records.empty()) {
+        replayMetadata(log, appliedSeq);
+        invalidateDentries();
+        resetSessions();
+        if (!metadata::save(filename + ".meta", inodeManager, *root, DiskManager::BLOCK_SIZE,
+                            diskManager.getBlockCount(), seq)) {
+            std::cerr << "Failed to save metadata: " << filename << ".meta" << std::endl;
+            return false;
+        }
+        std::cout << "Replayed " << log.records.size() << " journal records\n";
+        inodeManager.clearDirty();
+    }
+    imageName = filename;
+    namespaceDirty = false;
+    inodeManager.clearChanges();
+    diskManager.clearChanges();
+    if (!journal.open(filename + ".journal", seq)) {
+        std::cerr << "Failed to open journal: " << filename << ".journal" << std::endl;
+    }
+    return true;
+}
+
+// 元数据文件已包含序号不超过 appliedSeq 的批次，只回放之后的记录
+void FileSystemContext::replayMetadata(const Journal::Contents& log, uint64_t appliedSeq) {
+    // 目录按 inode 号索引；被 UNLINK 摘下的目录暂存起来，随后的 LINK 可能把它挂到别处（mv）
+    std::unordered_map<int, Directory*> dirs;
+    std::unordered_map<int, std::unique_ptr<Directory>> detached;
+    auto indexTree = [&]() {
+        dirs.clear();
+        detached.clear();
+        std::vector<Directory*> pending{root.get()};
+        while (!pending.empty()) {
+            Directory* dir = pending.back();
+            pending.pop_back();
+            dirs[dir->getInodeId()] = dir;
+            dir->forEachSubdir([&](Directory* sub) { pending.push_back(sub); });
+        }
+    };
+    indexTree();
+    auto parentOf = [&](const char* body) -> Directory* {
+        auto it = dirs.find(static_cast<int32_t>(metadata::getU32(body)));
+        return it == dirs.end() ? nullptr : it->second;
+    };
+
+    for (const Journal::Record& rec : log.records) {
+        if (rec.seq <= appliedSeq) continue;
+        switch (rec.type) {
+        case Journal::INODE:
+            if (rec.length == Inode::RECORD_SIZE) inodeManager.restoreInode(rec.body);
+            break;
+        case Journal::INODE_FREE:
+            if (rec.length >= 4) inodeManager.deleteInode(static_cast<int32_t>(metadata::getU32(rec.body)));
+            break;
+        case Journal::LINK: {
+            Directory* parent = rec.length >= 12 ? parentOf(rec.body) : nullptr;
+            if (!parent) break;
+            int inodeId = static_cast<int32_t>(metadata::getU32(rec.body + 4));
+            std::string name(rec.body + 12, rec.length - 12);
+            if (metadata::getU32(rec.body + 8) == DirEntry::DIRECTORY) {
+                if (parent->findSubdir(name)) break;
+                std::unique_ptr<Directory> dir;
+                auto it = detached.find(inodeId);
+                if (it != detached.end()) {
+                    dir = std::move(it->second);
+                    detached.erase(it);
+                } else {
+                    dir = std::make_unique<Directory>(name, inodeId);
+                }
+                dirs[inodeId] = parent->attachSubdir(std::move(dir), name);
+            } else if (parent->findFile(name) == -1) {
+                parent->addFile(name, inodeId);
+            }
+            break;
+        }
+        case Journal::UNLINK: {
+            Directory* parent = rec.length >= 8 ? parentOf(rec.body) : nullptr;
+            if (!parent) break;
+            std::string name(rec.body + 8, rec.length - 8);
+            if (metadata::getU32(rec.body + 4) == DirEntry::DIRECTORY) {
+                std::unique_ptr<Directory> dir = parent->detachSubdir(name);
+                if (dir) {
+                    int inodeId = dir->getInodeId();
+                    detached[inodeId] = std::move(dir);
+                }
+            } else if (parent->findFile(name) != -1) {
+                parent->removeFile(name);
+            }
+            break;
+        }
+        case Journal::TREE: {
+            // 快照回滚：整棵树替换，此前的目录项记录随之作废
+            if (rec.length < 8) break;
+            size_t dirCount = metadata::getU32(rec.body), entryCount = metadata::getU32(rec.body + 4);
+            size_t dirBytes = dirCount * metadata::DIR_RECORD_SIZE;
+            size_t entryBytes = entryCount * metadata::ENTRY_RECORD_SIZE;
+            if (8 + dirBytes + entryBytes > rec.length) break;
+            const char* body = rec.body + 8;
+            root = Directory::unpackTree(body, dirCount, body + dirBytes, entryCount,
+                                         std::string_view(body + dirBytes + entryBytes,
+                                                          rec.length - 8 - dirBytes - entryBytes));
+            indexTree();
+            break;
+        }
+        default:
+            break;   // DISK_WRITE 已在打开镜像前写入
+        }
+    }
+    inodeManager.rebuildFreeList();
+}
+
+void FileSystemContext::beginBatch() {
+    std::unique_lock<std::mutex> guard(locks->batch);
+    std::thread::id self = std::this_thread::get_id();
+    // 线程最外层的操作遇到提交、检查点或有人等待独占时先等候；已在批次中的线程继续嵌套，避免自己等自己
+    if (locks->owners.count(self) == 0) {
+        locks->batchIdle.wait(guard, [&] {
+            return !locks->exclusive && locks->drainers == 0 && locks->sinceCommit < MAX_GROUP_OPS;
+        });
+    }
+    ++locks->owners[self];
+    ++batchDepth;
+}
+
+void FileSystemContext::endBatch() {
+    std::unique_lock<std::mutex> guard(locks->batch);
+    auto it = locks->owners.find(std::this_thread::get_id());
+    if (it == locks->owners.end()) return;
+    if (--it->second == 0) {
+        locks->owners.erase(it);
+        ++locks->sinceCommit;
+    }
+    if (--batchDepth > 0) {
+        if (locks->drainers > 0) locks->batchIdle.notify_all();
+        return;
+    }
+
+    // 最后一个结束的操作负责提交，期间新操作在 beginBatch 中等待
+    locks->exclusive = true;
+    guard.unlock();
+    if (commitJournal() && journal.size() >= JOURNAL_CHECKPOINT_BYTES) {
+        std::shared_lock<std::shared_mutex> tree(locks->tree);
+        if (!checkpoint(imageName)) {
+            std::cerr << "Checkpoint failed: " << imageName << std::endl;
+        }
+    }
+    guard.lock();
+    locks->exclusive = false;
+    locks->sinceCommit = 0;
+    locks->batchIdle.notify_all();
+}
+
+void FileSystemContext::quiesce() {
+    std::unique_lock<std::mutex> guard(locks->batch);
+    auto it = locks->owners.find(std::this_thread::get_id());
+    int own = it == locks->owners.end() ? 0 : it->second;
+    ++locks->drainers;
+    locks->batchIdle.wait(guard, [&] { return !locks->exclusive && batchDepth == own; });
+    --locks->drainers;
+    locks->exclusive = true;
+}
+
+void FileSystemContext::resume() {
+    std::lock_guard<std::mutex> guard(locks->batch);
+    locks->exclusive = false;
+    locks->sinceCommit = 0;
+    locks->batchIdle.notify_all();
+}
+
+void FileSystemContext::setSecureErase(bool on) {
+    ExclusiveBatch exclusive(*this);
+    diskManager.setSecureErase(on);
+}
+
+const Journal& FileSystemContext::getJournal() const {
+    return journal;
+}
+
+void FileSystemContext::recordLink(Directory* parent, const std::string& name, int inodeId,
+                                   DirEntry::EntryType type) {
+    std::lock_guard<std::mutex> guard(locks->journal);
+    journal.logLink(parent->getInodeId(), name, inodeId, type);
+    namespaceDirty = true;
+}
+
+void FileSystemContext::recordUnlink(Directory* parent, const std::string& name, DirEntry::EntryType type) {
+    std::lock_guard<std::mutex> guard(locks->journal);
+    journal.logUnlink(parent->getInodeId(), name, type);
+    namespaceDirty = true;
+}
+
+// 收集上次提交以来改动过的块、位图字节和 inode，连同已记下的目录项改动作为一个批次提交
+bool FileSystemContext::commitJournal() {
+    if (!journal.isOpen()) return false;
+    diskManager.fillPendingZeros();   // 分配后未写过的块以 0 记入日志，回放时不会露出旧内容
+    diskManager.forEachChangedRun([&](int start, int count) {
+        journalScratch.resize(static_cast<size_t>(count) * DiskManager::BLOCK_SIZE);
+        diskManager.readBlocks(start, 0, static_cast<int>(journalScratch.size()), journalScratch.data());
+        journal.logDiskWrite(static_cast<uint64_t>(start) * DiskManager::BLOCK_SIZE,
+                             journalScratch.data(), journalScratch.size());
+    });
+    int lo, hi;
+    if (diskManager.changedBitmapRange(lo, hi)) {
+        journalScratch.resize(hi - lo);
+        for (int i = lo; i < hi; ++i) {
+            journalScratch[i - lo] = diskManager.isLive(i);
+        }
+        journal.logDiskWrite(static_cast<uint64_t>(diskManager.getBlockCount()) * DiskManager::BLOCK_SIZE + lo,
+                             journalScratch.data(), journalScratch.size());
+    }
+    inodeManager.forEachChanged([&](int id, const Inode* node) {
+        if (node) journal.logInode(*node);
+        else journal.logInodeFree(id);
+    });
+    if (!journal.commit()) {
+        // 改动集合保留，下次提交时重新收集；日志中未写出的记录也一并重试，回放时后写的记录覆盖先写的
+        std::cerr << "Journal commit failed: " << imageName << ".journal" << std::endl;
+        return false;
+    }
+    diskManager.clearChanges();
+    inodeManager.clearChanges();
+    return true;
 }
@@ -0,0 +1,89 @@
+#include "host_reader.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+HostReader::HostReader(std::vector<std::string> p, std::vector<uint64_t> s)
+    : paths(std::move(p)), sizes(std::move(s)) {
+    worker = std::thread(&HostReader::run, this);
+}
+
+HostReader::~HostReader() {
+    stop();
+    worker.join();
+}
+
+void HostReader::stop() {
+    std::lock_guard<std::mutex> guard(lock);
+    stopped = true;
+    ready.clear();
+    changed.notify_all();
+}
+
+bool HostReader::next(Chunk& chunk) {
+    std::unique_lock<std::mutex> guard(lock);
+    if (chunk.data.capacity() > 0) {
+        spare.push_back(std::move(chunk.data));
+        chunk.data = std::vector<char>();
+        changed.notify_all();
+    }
+    changed.wait(guard, [&] { return stopped || finished || !ready.empty(); });
+    if (stopped || ready.empty()) return false;
+    chunk = std::move(ready.front());
+    ready.pop_front();
+    changed.notify_all();
+    return true;
+}
+
+bool HostReader::push(Chunk&& chunk) {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [&] { return stopped || ready.size() < QUEUE_CHUNKS; });
+    if (stopped) return false;
+    ready.push_back(std::move(chunk));
+    changed.notify_all();
+    return true;
+}
+
+// 优先复用交还的缓冲区；队列满时 push 会等待，因此新分配的缓冲区个数有上限
+std::vector<char> HostReader::takeBuffer() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (spare.empty()) return std::vector<char>();
+    std::vector<char> buf = std::move(spare.back());
+    spare.pop_back();
+    return buf;
+}
+
+void HostReader::run() {
+    for (size_t i = 0; i < paths.size(); ++i) {
+        int fd = ::open(paths[i].c_str(), O_RDONLY);
+        uint64_t offset = 0;
+        bool last = false;
+        while (!last) {
+            Chunk chunk;
+            chunk.file = i;
+            chunk.offset = offset;
+            size_t want = static_cast<size_t>(std::min<uint64_t>(sizes[i] - offset, CHUNK_BYTES));
+            chunk.data = takeBuffer();
+            chunk.data.resize(want);
+            size_t got = 0;
+            while (fd >= 0 && got < want) {
+                ssize_t n = ::read(fd, chunk.data.data() + got, want - got);
+                if (n <= 0) break;
+                got += static_cast<size_t>(n);
+            }
+            offset += want;
+            chunk.failed = fd < 0 || got < want;
+            chunk.last = chunk.failed || offset == sizes[i];
+            if (chunk.failed) chunk.data.clear();
+            last = chunk.last;
+            if (!push(std::move(chunk))) {
+                if (fd >= 0) ::close(fd);
+                return;
+            }
+        }
+        if (fd >= 0) ::close(fd);
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    finished = true;
+    changed.notify_all();
+}
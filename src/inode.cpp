@@ -1,21 +1,148 @@
 #include "inode.h"
 #include "disk.h"
+#include "metadata.h"
 #include <cstring>
 #include <stdexcept>
 #include <algorithm>
 
 Inode::Inode()
-    : inodeId(-1), type(FILE), size(0), blockCount(0) {
+    : inodeId(-1), type(FILE), size(0), blockCount(0),
+      indirectBlock(-1), doubleIndirectBlock(-1), blockMapValid(true) {
     std::memset(directBlocks, -1, sizeof(directBlocks));
     createTime = std::time(nullptr);
     modifyTime = createTime;
 }
 
-void Inode::addBlock(int blockIdx) {
-    if (blockCount >= DIRECT_BLOCKS) {
-        throw std::runtime_error("Exceeded maximum number of direct blocks");
+namespace {
+
+int32_t readPointer(DiskManager& disk, int blk, int slot) {
+    int32_t value = -1;
+    disk.readBlocks(blk, slot * static_cast<int>(sizeof(int32_t)), sizeof(int32_t), reinterpret_cast<char*>(&value));
+    return value;
+}
+
+void writePointer(DiskManager& disk, int blk, int slot, int32_t value) {
+    disk.writeBlocks(blk, slot * static_cast<int>(sizeof(int32_t)), sizeof(int32_t), reinterpret_cast<const char*>(&value));
+}
+
+// 把间接块中前 count 个块号追加到 out
+void appendPointers(DiskManager& disk, int blk, int count, std::vector<int>& out) {
+    int32_t ptrs[Inode::PTRS_PER_BLOCK];
+    disk.readBlocks(blk, 0, count * static_cast<int>(sizeof(int32_t)), reinterpret_cast<char*>(ptrs));
+    out.insert(out.end(), ptrs, ptrs + count);
+}
+
+// blockCount 个数据块需要的二级间接表中的内层块数
+int innerCount(int count) {
+    int rel = count - Inode::DIRECT_BLOCKS - Inode::PTRS_PER_BLOCK;
+    return rel > 0 ? (rel + Inode::PTRS_PER_BLOCK - 1) / Inode::PTRS_PER_BLOCK : 0;
+}
+
+} // namespace
+
+int Inode::allocatePointerBlock(DiskManager& disk) {
+    int blk = disk.allocateBlock();
+    if (blk == -1) {
+        throw std::runtime_error("No free block for indirect block map");
+    }
+    return blk;
+}
+
+bool Inode::ownBlock(DiskManager& disk, int& blk) {
+    if (blk == -1 || !disk.isShared(blk)) return true;
+    int copy = disk.allocateBlock();
+    if (copy == -1) return false;
+    char buf[DiskManager::BLOCK_SIZE];
+    disk.readBlocks(blk, 0, DiskManager::BLOCK_SIZE, buf);
+    disk.writeBlocks(copy, 0, DiskManager::BLOCK_SIZE, buf);
+    disk.freeBlock(blk);   // 当前文件系统不再使用，块留给快照
+    blk = copy;
+    return true;
+}
+
+void Inode::ownPointerBlock(DiskManager& disk, int& blk) {
+    if (!ownBlock(disk, blk)) {
+        throw std::runtime_error("No free block for indirect block map");
+    }
+}
+
+bool Inode::setBlock(DiskManager& disk, int index, int blk) {
+    if (index < DIRECT_BLOCKS) {
+        directBlocks[index] = blk;
+    } else if (index < DIRECT_BLOCKS + PTRS_PER_BLOCK) {
+        if (!ownBlock(disk, indirectBlock)) return false;
+        writePointer(disk, indirectBlock, index - DIRECT_BLOCKS, blk);
+    } else {
+        int rel = index - DIRECT_BLOCKS - PTRS_PER_BLOCK;
+        if (!ownBlock(disk, doubleIndirectBlock)) return false;
+        int innerBlock = readPointer(disk, doubleIndirectBlock, rel / PTRS_PER_BLOCK);
+        int owned = innerBlock;
+        if (!ownBlock(disk, owned)) return false;
+        if (owned != innerBlock) writePointer(disk, doubleIndirectBlock, rel / PTRS_PER_BLOCK, owned);
+        writePointer(disk, owned, rel % PTRS_PER_BLOCK, blk);
+    }
+    if (blockMapValid) blockMapCache[index] = blk;
+    return true;
+}
+
+bool Inode::unshareBlocks(DiskManager& disk, int first, int last) {
+    if (!disk.hasShared()) return true;
+    last = std::min(last, blockCount);
+    for (int i = std::max(first, 0); i < last; ++i) {
+        int blk = blockAt(disk, i);
+        int owned = blk;
+        if (!ownBlock(disk, owned)) return false;
+        if (owned != blk && !setBlock(disk, i, owned)) {
+            // 块映射没能改写，副本作废，原块重新由当前文件系统使用
+            disk.adoptBlock(blk);
+            disk.freeBlock(owned);
+            return false;
+        }
     }
-    directBlocks[blockCount++] = blockIdx;
+    return true;
+}
+
+void Inode::collectBlocks(DiskManager& disk, std::vector<int>& out) const {
+    const std::vector<int>& blocks = getBlockMap(disk);
+    out.insert(out.end(), blocks.begin(), blocks.end());
+    if (indirectBlock != -1) out.push_back(indirectBlock);
+    if (doubleIndirectBlock != -1) {
+        out.push_back(doubleIndirectBlock);
+        appendPointers(disk, doubleIndirectBlock, innerCount(blockCount), out);
+    }
+}
+
+void Inode::addBlock(DiskManager& disk, int blockIdx) {
+    if (blockCount >= MAX_BLOCKS) {
+        throw std::runtime_error("Exceeded maximum number of blocks per file");
+    }
+    int index = blockCount;
+    if (index < DIRECT_BLOCKS) {
+        directBlocks[index] = blockIdx;
+    } else if (index < DIRECT_BLOCKS + PTRS_PER_BLOCK) {
+        if (indirectBlock == -1) indirectBlock = allocatePointerBlock(disk);
+        ownPointerBlock(disk, indirectBlock);
+        writePointer(disk, indirectBlock, index - DIRECT_BLOCKS, blockIdx);
+    } else {
+        int rel = index - DIRECT_BLOCKS - PTRS_PER_BLOCK;
+        if (doubleIndirectBlock == -1) doubleIndirectBlock = allocatePointerBlock(disk);
+        ownPointerBlock(disk, doubleIndirectBlock);
+        int outer = rel / PTRS_PER_BLOCK;
+        int inner = rel % PTRS_PER_BLOCK;
+        int innerBlock;
+        if (inner == 0) {
+            innerBlock = allocatePointerBlock(disk);
+            writePointer(disk, doubleIndirectBlock, outer, innerBlock);
+        } else {
+            innerBlock = readPointer(disk, doubleIndirectBlock, outer);
+            int shared = innerBlock;
+            ownPointerBlock(disk, innerBlock);
+            if (innerBlock != shared) writePointer(disk, doubleIndirectBlock, outer, innerBlock);
+        }
+        writePointer(disk, innerBlock, inner, blockIdx);
+    }
+    ++blockCount;
+    if (blockMapValid) blockMapCache.push_back(blockIdx);
     modifyTime = std::time(nullptr);
 }
 
@@ -23,51 +150,270 @@ const int* Inode::getBlocks() const {
     return directBlocks;
 }
 
+void Inode::addExtent(DiskManager& disk, int start, int length) {
+    for (int i = 0; i < length; ++i) {
+        try {
+            addBlock(disk, start + i);
+        } catch (...) {
+            // 未记录进块映射的部分归还给磁盘
+            for (int j = i; j < length; ++j) disk.freeBlock(start + j);
+            throw;
+        }
+    }
+}
+
+bool Inode::blockMapCached() const {
+    return blockMapValid;
+}
+
+const std::vector<int>& Inode::getBlockMap(DiskManager& disk) const {
+    if (blockMapValid) return blockMapCache;
+
+    blockMapCache.clear();
+    blockMapCache.reserve(blockCount);
+    int n = std::min(blockCount, DIRECT_BLOCKS);
+    blockMapCache.insert(blockMapCache.end(), directBlocks, directBlocks + n);
+
+    int remaining = blockCount - n;
+    if (remaining > 0) {
+        int count = std::min(remaining, PTRS_PER_BLOCK);
+        appendPointers(disk, indirectBlock, count, blockMapCache);
+        remaining -= count;
+    }
+    for (int outer = 0; remaining > 0; ++outer) {
+        int innerBlock = readPointer(disk, doubleIndirectBlock, outer);
+        int count = std::min(remaining, PTRS_PER_BLOCK);
+        appendPointers(disk, innerBlock, count, blockMapCache);
+        remaining -= count;
+    }
+    blockMapValid = true;
+    return blockMapCache;
+}
+
+int Inode::blockAt(DiskManager& disk, int index) const {
+    if (index < 0 || index >= blockCount) return -1;
+    if (index < DIRECT_BLOCKS) return directBlocks[index];
+    return getBlockMap(disk)[index];
+}
+
+bool Inode::growBlocks(DiskManager& disk, int newCount, int hint) {
+    if (newCount > MAX_BLOCKS) return false;
+    if (hint < 0 && blockCount > 0) hint = blockAt(disk, blockCount - 1) + 1; // 紧接最后一块继续分配
+
+    // 尽量一次分配整段连续块，空间碎片化时逐步缩小请求长度
+    int remaining = newCount - blockCount;
+    int want = remaining;
+    try {
+        while (remaining > 0) {
+            int start = disk.allocateExtent(want, hint);
+            if (start == -1) {
+                if (want == 1) return false;
+                want = (want + 1) / 2;
+                continue;
+            }
+            addExtent(disk, start, want);
+            hint = start + want;
+            remaining -= want;
+            want = std::min(want, remaining);
+        }
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    return true;
+}
+
+void Inode::shrinkBlocks(DiskManager& disk, int newCount) {
+    if (newCount >= blockCount) return;
+    // 数据块按连续区间整段释放
+    forEachExtent(disk, newCount, blockCount, [&](const Extent& ext, int) {
+        disk.freeExtent(ext.start, ext.length);
+    });
+
+    // 释放不再需要的间接块
+    if (doubleIndirectBlock != -1) {
+        int keep = innerCount(newCount);
+        for (int outer = keep; outer < innerCount(blockCount); ++outer) {
+            disk.freeBlock(readPointer(disk, doubleIndirectBlock, outer));
+        }
+        if (keep == 0) {
+            disk.freeBlock(doubleIndirectBlock);
+            doubleIndirectBlock = -1;
+        }
+    }
+    if (indirectBlock != -1 && newCount <= DIRECT_BLOCKS) {
+        disk.freeBlock(indirectBlock);
+        indirectBlock = -1;
+    }
+    for (int i = newCount; i < DIRECT_BLOCKS; ++i) {
+        directBlocks[i] = -1;
+    }
+    blockCount = newCount;
+    blockMapCache.resize(newCount);
+    modifyTime = std::time(nullptr);
+}
+
+int Inode::read(DiskManager& disk, int offset, int length, char* buffer) const {
+    if (offset < 0 || length <= 0 || offset >= size) return 0;
+    int end = std::min(size, offset + length);
+    const int bs = DiskManager::BLOCK_SIZE;
+
+    int done = 0;
+    forEachExtent(disk, offset / bs, (end - 1) / bs + 1, [&](const Extent& ext, int index) {
+        int from = std::max(offset, index * bs);
+        int to = std::min(end, (index + ext.length) * bs);
+        disk.readBlocks(ext.start, from - index * bs, to - from, buffer + (from - offset));
+        done += to - from;
+    });
+    return done;
+}
+
+int Inode::write(DiskManager& disk, int offset, int length, const char* data) {
+    if (offset < 0 || length < 0) return -1;
+    if (length == 0) return 0;
+    long long endPos = static_cast<long long>(offset) + length;
+    const int bs = DiskManager::BLOCK_SIZE;
+    if (endPos > static_cast<long long>(MAX_BLOCKS) * bs) return -1;
+
+    int end = static_cast<int>(endPos);
+    int blocksNeeded = (end + bs - 1) / bs;
+    if (blocksNeeded > blockCount) {
+        int oldCount = blockCount;
+        if (!growBlocks(disk, blocksNeeded, -1)) {
+            shrinkBlocks(disk, oldCount); // 回退本次分配的块
+            return -1;
+        }
+    }
+    // 被快照共享的块先复制一份再写
+    if (!unshareBlocks(disk, offset / bs, blocksNeeded)) return -1;
+
+    forEachExtent(disk, offset / bs, (end - 1) / bs + 1, [&](const Extent& ext, int index) {
+        int from = std::max(offset, index * bs);
+        int to = std::min(end, (index + ext.length) * bs);
+        disk.writeBlocks(ext.start, from - index * bs, to - from, data + (from - offset));
+    });
+    size = std::max(size, end);
+    modifyTime = std::time(nullptr);
+    return length;
+}
+
+int Inode::write(DiskManager& disk, int offset, std::string_view data) {
+    if (data.size() > static_cast<size_t>(MAX_BLOCKS) * DiskManager::BLOCK_SIZE) return -1;
+    return write(disk, offset, static_cast<int>(data.size()), data.data());
+}
+
+bool Inode::truncate(DiskManager& disk, int newSize) {
+    if (newSize < 0) return false;
+    const int bs = DiskManager::BLOCK_SIZE;
+    int blocksNeeded = (newSize + bs - 1) / bs;
+    if (newSize < size) {
+        if (newSize % bs != 0 && !unshareBlocks(disk, blocksNeeded - 1, blocksNeeded)) return false;
+        shrinkBlocks(disk, blocksNeeded);
+        // 末块中超出新长度的部分清零，之后再扩展时读到的是 0
+        int tail = newSize % bs;
+        if (tail != 0) {
+            static const char zeros[DiskManager::BLOCK_SIZE] = {0};
+            disk.writeBlocks(blockAt(disk, blocksNeeded - 1), tail, bs - tail, zeros);
+        }
+    } else if (blocksNeeded > blockCount) {
+        int oldCount = blockCount;
+        if (!growBlocks(disk, blocksNeeded, -1)) {
+            shrinkBlocks(disk, oldCount);
+            return false;
+        }
+    }
+    size = newSize;
+    modifyTime = std::time(nullptr);
+    return true;
+}
+
 bool Inode::writeData(DiskManager& disk, const char* data, int length) {
-    // 清楚之前的数据
-    clearData(disk);
-    
-    int blocksNeeded = (length + DiskManager::BLOCK_SIZE - 1) / DiskManager::BLOCK_SIZE;
-    std::string content = data ? std::string(data, length) : "";
-    if (blocksNeeded > DIRECT_BLOCKS) return false;
-
-    for (int i = 0; i < blocksNeeded; ++i) {
-        int blk = disk.allocateBlock();
-        if (blk == -1) return false;
-        addBlock(blk);
-
-        int copySize = std::min(DiskManager::BLOCK_SIZE, length - i * DiskManager::BLOCK_SIZE);
-        std::memcpy(disk.getBlock(blk), content.c_str() + i * DiskManager::BLOCK_SIZE, copySize);
-        std::string blockContent = std::string(disk.getBlock(blk), copySize);
-    }
-    size = length;
+    if (length < 0) return false;
+    // 原有的块按顺序原地改写，只为长度差分配或释放块；data 为空时内容为全 0
+    bool ok;
+    if (!data) {
+        ok = truncate(disk, 0) && truncate(disk, length);
+    } else {
+        ok = (length >= size || truncate(disk, length)) &&
+             (length == 0 || write(disk, 0, length, data) == length);
+    }
+    if (!ok) {
+        clearData(disk);
+        return false;
+    }
     modifyTime = std::time(nullptr);
     return true;
 }
 
+bool Inode::writeData(DiskManager& disk, std::string_view data) {
+    if (data.size() > static_cast<size_t>(MAX_BLOCKS) * DiskManager::BLOCK_SIZE) return false;
+    return writeData(disk, data.data(), static_cast<int>(data.size()));
+}
+
 bool Inode::readData(DiskManager& disk, char* buffer, int maxLength) const {
     if (size > maxLength) return false;
-
-    int offset = 0;
-    for (int i = 0; i < blockCount; ++i) {
-        int remaining = size - offset;
-        if (remaining <= 0) break;
-
-        int copySize = std::min(DiskManager::BLOCK_SIZE, remaining);
-        std::string blockContent = std::string(disk.getBlock(directBlocks[i]), copySize);
-        std::memcpy(buffer + offset, disk.getBlock(directBlocks[i]), copySize);
-        offset += copySize;
-    }
-    std::string content = std::string(buffer, offset);
+    read(disk, 0, size, buffer);
     return true;
 }
 
 void Inode::clearData(DiskManager& disk) {
-    for (int i = 0; i < blockCount; ++i) {
-        disk.freeBlock(directBlocks[i]);
-    }
-    std::memset(directBlocks, -1, sizeof(directBlocks));
-    blockCount = 0;
+    shrinkBlocks(disk, 0);
+    blockMapCache.clear();
+    blockMapValid = true;
     size = 0;
     modifyTime = std::time(nullptr);
-}
\ No newline at end of file
+}
+
+// 定长记录布局（小端）：
+//   0 inodeId  4 type  8 size(u64)  16 blockCount  20 directBlocks[8]
+//   52 indirectBlock  56 doubleIndirectBlock  64 createTime(i64)  72 modifyTime(i64)
+void Inode::encode(char* rec) const {
+    using namespace metadata;
+    std::memset(rec, 0, RECORD_SIZE);
+    putU32(rec, static_cast<uint32_t>(inodeId));
+    putU32(rec + 4, static_cast<uint32_t>(type));
+    putU64(rec + 8, static_cast<uint64_t>(size));
+    putU32(rec + 16, static_cast<uint32_t>(blockCount));
+    for (int i = 0; i < DIRECT_BLOCKS; ++i) {
+        putU32(rec + 20 + 4 * i, static_cast<uint32_t>(directBlocks[i]));
+    }
+    putU32(rec + 52, static_cast<uint32_t>(indirectBlock));
+    putU32(rec + 56, static_cast<uint32_t>(doubleIndirectBlock));
+    putU64(rec + 64, static_cast<uint64_t>(static_cast<int64_t>(createTime)));
+    putU64(rec + 72, static_cast<uint64_t>(static_cast<int64_t>(modifyTime)));
+}
+
+void Inode::decode(const char* rec) {
+    using namespace metadata;
+    inodeId = static_cast<int32_t>(getU32(rec));
+    type = getU32(rec + 4) == DIRECTORY ? DIRECTORY : FILE;
+    size = static_cast<int>(getU64(rec + 8));
+    blockCount = static_cast<int32_t>(getU32(rec + 16));
+    for (int i = 0; i < DIRECT_BLOCKS; ++i) {
+        directBlocks[i] = static_cast<int32_t>(getU32(rec + 20 + 4 * i));
+    }
+    indirectBlock = static_cast<int32_t>(getU32(rec + 52));
+    doubleIndirectBlock = static_cast<int32_t>(getU32(rec + 56));
+    createTime = static_cast<time_t>(static_cast<int64_t>(getU64(rec + 64)));
+    modifyTime = static_cast<time_t>(static_cast<int64_t>(getU64(rec + 72)));
+    if (size < 0 || blockCount < 0 || blockCount > MAX_BLOCKS) {
+        throw std::runtime_error("Corrupted inode record");
+    }
+    blockMapCache.clear();
+    blockMapValid = false;
+}
+
+void Inode::deserialize(std::istream& in) {
+    int typeInt;
+    in.read(reinterpret_cast<char*>(&inodeId), sizeof(inodeId));
+    in.read(reinterpret_cast<char*>(&typeInt), sizeof(typeInt));
+    in.read(reinterpret_cast<char*>(&size), sizeof(size));
+    in.read(reinterpret_cast<char*>(&blockCount), sizeof(blockCount));
+    in.read(reinterpret_cast<char*>(directBlocks), sizeof(directBlocks));
+    in.read(reinterpret_cast<char*>(&indirectBlock), sizeof(indirectBlock));
+    in.read(reinterpret_cast<char*>(&doubleIndirectBlock), sizeof(doubleIndirectBlock));
+    in.read(reinterpret_cast<char*>(&createTime), sizeof(createTime));
+    in.read(reinterpret_cast<char*>(&modifyTime), sizeof(modifyTime));
+    type = static_cast<FileType>(typeInt);
+    blockMapCache.clear();
+    blockMapValid = false; // 间接块在磁盘上，首次访问时再展开
+}
@@ -1,52 +1,237 @@
 #include "inode_manager.h"
+#include "metadata.h"
 #include <stdexcept>
+#include <algorithm>
+#include <cstring>
 
-InodeManager::InodeManager() : nextInodeId(1) {} // inode 0 通常保留给根目录
+InodeManager::InodeManager() : nextInodeId(1), freeHead(-1), liveCount(0) {} // inode 0 通常保留给根目录
+
+InodeManager::InodeManager(InodeManager&& other) noexcept
+    : chunks(std::move(other.chunks)), nextInodeId(other.nextInodeId), freeHead(other.freeHead),
+      liveCount(other.liveCount), changedIds(std::move(other.changedIds)), dirtyIds(std::move(other.dirtyIds)) {
+    other.nextInodeId = 1;
+    other.freeHead = -1;
+    other.liveCount = 0;
+}
+
+InodeManager& InodeManager::operator=(InodeManager&& other) noexcept {
+    if (this != &other) {
+        chunks = std::move(other.chunks);
+        nextInodeId = other.nextInodeId;
+        freeHead = other.freeHead;
+        liveCount = other.liveCount;
+        changedIds = std::move(other.changedIds);
+        dirtyIds = std::move(other.dirtyIds);
+        other.nextInodeId = 1;
+        other.freeHead = -1;
+        other.liveCount = 0;
+    }
+    return *this;
+}
+
+InodeManager::Slot& InodeManager::slotAt(int inodeId) {
+    return chunks[inodeId >> CHUNK_SHIFT][inodeId & (CHUNK_SIZE - 1)];
+}
+
+const InodeManager::Slot& InodeManager::slotAt(int inodeId) const {
+    return chunks[inodeId >> CHUNK_SHIFT][inodeId & (CHUNK_SIZE - 1)];
+}
+
+void InodeManager::ensureCapacity(int inodeId) {
+    while (static_cast<size_t>(inodeId >> CHUNK_SHIFT) >= chunks.size()) {
+        chunks.emplace_back(new Slot[CHUNK_SIZE]);
+    }
+}
 
 int InodeManager::allocateInode(Inode::FileType type) {
-    int id = nextInodeId++;
-    Inode node;
-    node.inodeId = id;
-    node.type = type;
-    inodeTable[id] = node;
+    std::unique_lock<std::shared_mutex> guard(tableLock);
+    return takeSlot(type);
+}
+
+void InodeManager::allocateInodes(Inode::FileType type, int count, std::vector<int>& ids) {
+    std::unique_lock<std::shared_mutex> guard(tableLock);
+    ids.reserve(ids.size() + count);
+    for (int i = 0; i < count; ++i) ids.push_back(takeSlot(type));
+}
+
+int InodeManager::takeSlot(Inode::FileType type) {
+    int id;
+    if (freeHead != -1) {
+        id = freeHead;
+        freeHead = slotAt(id).nextFree;
+    } else {
+        id = nextInodeId++;
+        ensureCapacity(id);
+    }
+    Slot& slot = slotAt(id);
+    slot.node = Inode();
+    slot.node.inodeId = id;
+    slot.node.type = type;
+    slot.nextFree = LIVE;
+    ++liveCount;
+    noteChanged(slot, id);
     return id;
 }
 
 Inode* InodeManager::getInode(int inodeId) {
-    auto it = inodeTable.find(inodeId);
-    if (it != inodeTable.end()) {
-        return &(it->second);
-    }
-    return nullptr;
+    std::shared_lock<std::shared_mutex> guard(tableLock);
+    if (inodeId <= 0 || inodeId >= nextInodeId) return nullptr;
+    Slot& slot = slotAt(inodeId);
+    return slot.nextFree == LIVE ? &slot.node : nullptr;
+}
+
+std::shared_mutex& InodeManager::inodeLock(int inodeId) {
+    std::shared_lock<std::shared_mutex> guard(tableLock);
+    if (inodeId <= 0 || inodeId >= nextInodeId) throw std::out_of_range("Invalid inode id");
+    return slotAt(inodeId).lock;
 }
 
 void InodeManager::deleteInode(int inodeId) {
-    inodeTable.erase(inodeId);
+    std::unique_lock<std::shared_mutex> guard(tableLock);
+    releaseSlot(inodeId);
+}
+
+void InodeManager::deleteInodes(const std::vector<int>& ids) {
+    std::unique_lock<std::shared_mutex> guard(tableLock);
+    for (int id : ids) releaseSlot(id);
+}
+
+void InodeManager::releaseSlot(int inodeId) {
+    if (inodeId <= 0 || inodeId >= nextInodeId) return;
+    Slot& slot = slotAt(inodeId);
+    if (slot.nextFree != LIVE) return;
+    slot.node = Inode();   // 释放块映射缓存等内存
+    slot.nextFree = freeHead;
+    freeHead = inodeId;
+    --liveCount;
+    noteChanged(slot, inodeId);
 }
 
+void InodeManager::markChanged(int inodeId) {
+    std::unique_lock<std::shared_mutex> guard(tableLock);
+    if (inodeId <= 0 || inodeId >= nextInodeId) return;
+    noteChanged(slotAt(inodeId), inodeId);
+}
 
-void InodeManager::serialize(std::ostream& out) {
-    out.write(reinterpret_cast<char*>(&nextInodeId), sizeof(nextInodeId));
-    size_t count = inodeTable.size();
-    out.write(reinterpret_cast<char*>(&count), sizeof(count));
-    for (const auto& [id, inode] : inodeTable) {
-        out.write(reinterpret_cast<const char*>(&id), sizeof(id));
-        out.write(reinterpret_cast<const char*>(&inode), sizeof(Inode));
+void InodeManager::noteChanged(Slot& slot, int inodeId) {
+    if (!(slot.pending & IN_CHANGED)) changedIds.push_back(inodeId);
+    if (!(slot.pending & IN_DIRTY)) dirtyIds.push_back(inodeId);
+    slot.pending = IN_CHANGED | IN_DIRTY;
+}
+
+void InodeManager::clearChanges() {
+    for (int id : changedIds) {
+        slotAt(id).pending &= ~IN_CHANGED;
+    }
+    changedIds.clear();
+}
+
+const std::vector<int>& InodeManager::dirtySlots() const {
+    return dirtyIds;
+}
+
+void InodeManager::clearDirty() {
+    for (int id : dirtyIds) {
+        slotAt(id).pending &= ~IN_DIRTY;
+    }
+    dirtyIds.clear();
+}
+
+void InodeManager::restoreInode(const char* record) {
+    int id = static_cast<int32_t>(metadata::getU32(record));
+    if (id <= 0) throw std::runtime_error("Corrupted inode record");
+    if (id >= nextInodeId) {
+        ensureCapacity(id);
+        nextInodeId = id + 1;
+    }
+    Slot& slot = slotAt(id);
+    slot.node.decode(record);
+    if (slot.nextFree != LIVE) {
+        slot.nextFree = LIVE;
+        ++liveCount;
+    }
+}
+
+int InodeManager::inodeCount() const {
+    std::shared_lock<std::shared_mutex> guard(tableLock);
+    return liveCount;
+}
+
+
+int InodeManager::highWater() const {
+    return nextInodeId;
+}
+
+void InodeManager::packTable(std::vector<char>& out, int capacity) const {
+    out.assign(static_cast<size_t>(std::max(capacity, nextInodeId)) * Inode::RECORD_SIZE, 0);
+    for (int id = 1; id < nextInodeId; ++id) {
+        const Slot& slot = slotAt(id);
+        if (slot.nextFree == LIVE) slot.node.encode(out.data() + static_cast<size_t>(id) * Inode::RECORD_SIZE);
+    }
+}
+
+void InodeManager::encodeSlot(int inodeId, char* record) const {
+    if (inodeId > 0 && inodeId < nextInodeId && slotAt(inodeId).nextFree == LIVE) {
+        slotAt(inodeId).node.encode(record);
+    } else {
+        std::memset(record, 0, Inode::RECORD_SIZE);
+    }
+}
+
+void InodeManager::unpackTable(const char* records, size_t count, int nextId) {
+    chunks.clear();
+    changedIds.clear();
+    dirtyIds.clear();
+    freeHead = -1;
+    liveCount = 0;
+    nextInodeId = nextId < 1 ? 1 : nextId;
+    ensureCapacity(nextInodeId - 1);
+    for (size_t i = 0; i < count; ++i, records += Inode::RECORD_SIZE) {
+        int id = static_cast<int32_t>(metadata::getU32(records));
+        if (id == 0) continue;   // 空闲槽位
+        if (id < 0 || id >= nextInodeId || slotAt(id).nextFree == LIVE) {
+            throw std::runtime_error("Corrupted inode table");
+        }
+        Slot& slot = slotAt(id);
+        slot.node.decode(records);   // 直接解码到槽位，不经过临时对象
+        slot.nextFree = LIVE;
+        ++liveCount;
+    }
+    rebuildFreeList();
+}
+
+// 由高到低压入空闲 id，使较小的 id 先被复用
+void InodeManager::rebuildFreeList() {
+    freeHead = -1;
+    for (int id = nextInodeId - 1; id >= 1; --id) {
+        Slot& slot = slotAt(id);
+        if (slot.nextFree == LIVE) continue;
+        slot.nextFree = freeHead;
+        freeHead = id;
     }
 }
 
 void InodeManager::deserialize(std::istream& in) {
-    inodeTable.clear();
+    chunks.clear();
+    changedIds.clear();
+    dirtyIds.clear();
+    freeHead = -1;
+    liveCount = 0;
     in.read(reinterpret_cast<char*>(&nextInodeId), sizeof(nextInodeId));
     size_t count;
     in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (nextInodeId < 1) nextInodeId = 1;
+    ensureCapacity(nextInodeId - 1);
     for (size_t i = 0; i < count; ++i) {
         int id;
-        Inode inode;
         in.read(reinterpret_cast<char*>(&id), sizeof(id));
-        in.read(reinterpret_cast<char*>(&inode), sizeof(Inode));
-        inodeTable[id] = inode;
+        if (!in || id <= 0 || id >= nextInodeId) {
+            throw std::runtime_error("Corrupted inode table");
+        }
+        Slot& slot = slotAt(id);
+        slot.node.deserialize(in);
+        slot.nextFree = LIVE;
+        ++liveCount;
     }
+    rebuildFreeList();
 }
-
-
@@ -0,0 +1,253 @@
+#include "journal.h"
+#include "metadata.h"
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+using metadata::putU32;
+using metadata::putU64;
+using metadata::getU32;
+using metadata::getU64;
+
+namespace {
+
+// 32 位 FNV-1a，用于发现写到一半的批次
+uint32_t checksum(const char* data, size_t length, uint64_t seq) {
+    uint32_t h = 2166136261u ^ static_cast<uint32_t>(seq);
+    for (size_t i = 0; i < length; ++i) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+} // namespace
+
+// 批次布局：0 魔数  4 记录数  8 序号  16 负载字节数  20 校验和  24 保留，随后为记录；
+// 每条记录为 4 字节类型、4 字节长度和记录体
+Journal::Journal() : fd(-1), seq(0), fileSize(0), pendingCount(0), pending(HEADER_SIZE, 0) {}
+
+Journal::~Journal() {
+    close();
+}
+
+Journal::Journal(Journal&& other) noexcept
+    : fd(other.fd), seq(other.seq), fileSize(other.fileSize), pendingCount(other.pendingCount),
+      pending(std::move(other.pending)), counters(other.counters) {
+    other.fd = -1;
+    other.pending.assign(HEADER_SIZE, 0);
+    other.pendingCount = 0;
+}
+
+Journal& Journal::operator=(Journal&& other) noexcept {
+    if (this != &other) {
+        close();
+        fd = other.fd;
+        seq = other.seq;
+        fileSize = other.fileSize;
+        pendingCount = other.pendingCount;
+        pending = std::move(other.pending);
+        counters = other.counters;
+        other.fd = -1;
+        other.pending.assign(HEADER_SIZE, 0);
+        other.pendingCount = 0;
+    }
+    return *this;
+}
+
+bool Journal::open(const std::string& path, uint64_t lastSeq) {
+    close();
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) return false;
+    ::fdatasync(fd);
+    seq = lastSeq;
+    fileSize = 0;
+    return true;
+}
+
+void Journal::close() {
+    if (fd != -1) ::close(fd);
+    fd = -1;
+    pending.resize(HEADER_SIZE);
+    pendingCount = 0;
+}
+
+bool Journal::isOpen() const {
+    return fd != -1;
+}
+
+char* Journal::appendRecord(uint32_t type, size_t length) {
+    size_t pos = pending.size();
+    pending.resize(pos + 8 + length);
+    putU32(pending.data() + pos, type);
+    putU32(pending.data() + pos + 4, static_cast<uint32_t>(length));
+    ++pendingCount;
+    return pending.data() + pos + 8;
+}
+
+void Journal::logDiskWrite(uint64_t offset, const char* data, size_t length) {
+    if (fd == -1) return;
+    char* body = appendRecord(DISK_WRITE, 8 + length);
+    putU64(body, offset);
+    std::memcpy(body + 8, data, length);
+}
+
+void Journal::logInode(const Inode& node) {
+    if (fd == -1) return;
+    node.encode(appendRecord(INODE, Inode::RECORD_SIZE));
+}
+
+void Journal::logInodeFree(int inodeId) {
+    if (fd == -1) return;
+    putU32(appendRecord(INODE_FREE, 4), static_cast<uint32_t>(inodeId));
+}
+
+// LINK：父目录 inode、inode、类型、名字；UNLINK：父目录 inode、类型、名字
+void Journal::logLink(int parentInode, const std::string& name, int inodeId, DirEntry::EntryType type) {
+    if (fd == -1) return;
+    char* body = appendRecord(LINK, 12 + name.size());
+    putU32(body, static_cast<uint32_t>(parentInode));
+    putU32(body + 4, static_cast<uint32_t>(inodeId));
+    putU32(body + 8, static_cast<uint32_t>(type));
+    std::memcpy(body + 12, name.data(), name.size());
+}
+
+void Journal::logUnlink(int parentInode, const std::string& name, DirEntry::EntryType type) {
+    if (fd == -1) return;
+    char* body = appendRecord(UNLINK, 8 + name.size());
+    putU32(body, static_cast<uint32_t>(parentInode));
+    putU32(body + 4, static_cast<uint32_t>(type));
+    std::memcpy(body + 8, name.data(), name.size());
+}
+
+// TREE：目录数、文件项数，随后是 packTree 的目录表、文件项表和字符串表
+void Journal::logTree(const std::vector<char>& dirs, const std::vector<char>& entries, const std::string& strings) {
+    if (fd == -1) return;
+    char* body = appendRecord(TREE, 8 + dirs.size() + entries.size() + strings.size());
+    putU32(body, static_cast<uint32_t>(dirs.size() / metadata::DIR_RECORD_SIZE));
+    putU32(body + 4, static_cast<uint32_t>(entries.size() / metadata::ENTRY_RECORD_SIZE));
+    body += 8;
+    std::memcpy(body, dirs.data(), dirs.size());
+    std::memcpy(body + dirs.size(), entries.data(), entries.size());
+    std::memcpy(body + dirs.size() + entries.size(), strings.data(), strings.size());
+}
+
+bool Journal::hasPending() const {
+    return pendingCount > 0;
+}
+
+bool Journal::commit() {
+    if (fd == -1 || pendingCount == 0) return true;
+    uint64_t batchSeq = seq + 1;
+    char* header = pending.data();
+    size_t payload = pending.size() - HEADER_SIZE;
+    std::memset(header, 0, HEADER_SIZE);
+    putU32(header, MAGIC);
+    putU32(header + 4, pendingCount);
+    putU64(header + 8, batchSeq);
+    putU32(header + 16, static_cast<uint32_t>(payload));
+    putU32(header + 20, checksum(header + HEADER_SIZE, payload, batchSeq));
+
+    // 整个批次一次写入，再落盘一次
+    ssize_t n = ::write(fd, pending.data(), pending.size());
+    if (n != static_cast<ssize_t>(pending.size()) || ::fdatasync(fd) != 0) {
+        // 截掉写了一半的批次并退回原位置，否则之后的批次接在它后面，回放时停在这里被一并丢弃。
+        // 待提交记录保留，下次提交时连同新记录重试
+        if (::ftruncate(fd, static_cast<off_t>(fileSize)) == 0) ::lseek(fd, static_cast<off_t>(fileSize), SEEK_SET);
+        return false;
+    }
+
+    seq = batchSeq;
+    fileSize += pending.size();
+    ++counters.commits;
+    counters.records += pendingCount;
+    counters.bytes += pending.size();
+    pending.resize(HEADER_SIZE);
+    pendingCount = 0;
+    return true;
+}
+
+bool Journal::reset() {
+    pending.resize(HEADER_SIZE);
+    pendingCount = 0;
+    if (fd == -1) return true;
+    if (::ftruncate(fd, 0) != 0 || ::fdatasync(fd) != 0) return false;
+    fileSize = 0;
+    return true;
+}
+
+uint64_t Journal::lastSeq() const {
+    return seq;
+}
+
+uint64_t Journal::size() const {
+    return fileSize;
+}
+
+const Journal::Stats& Journal::stats() const {
+    return counters;
+}
+
+Journal::Contents Journal::read(const std::string& path) {
+    Contents contents;
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) return contents;
+    contents.data.resize(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    in.read(contents.data.data(), static_cast<std::streamsize>(contents.data.size()));
+    if (!in) {
+        contents.data.clear();
+        return contents;
+    }
+
+    // 逐个批次校验，遇到第一个不完整或校验失败的批次即停止
+    const char* p = contents.data.data();
+    size_t remaining = contents.data.size();
+    while (remaining >= HEADER_SIZE && getU32(p) == MAGIC) {
+        uint32_t count = getU32(p + 4);
+        uint64_t batchSeq = getU64(p + 8);
+        uint32_t payload = getU32(p + 16);
+        if (payload > remaining - HEADER_SIZE || batchSeq <= contents.lastSeq ||
+            checksum(p + HEADER_SIZE, payload, batchSeq) != getU32(p + 20)) {
+            break;
+        }
+
+        std::vector<Record> batch;
+        const char* rec = p + HEADER_SIZE;
+        const char* end = rec + payload;
+        while (rec + 8 <= end) {
+            uint32_t length = getU32(rec + 4);
+            if (length > static_cast<size_t>(end - rec - 8)) break;
+            batch.push_back(Record{batchSeq, getU32(rec), rec + 8, length});
+            rec += 8 + length;
+        }
+        if (rec != end || batch.size() != count) break;
+
+        contents.records.insert(contents.records.end(), batch.begin(), batch.end());
+        contents.lastSeq = batchSeq;
+        p += HEADER_SIZE + payload;
+        remaining -= HEADER_SIZE + payload;
+    }
+    return contents;
+}
+
+bool Journal::applyToImage(const Contents& contents, const std::string& imagePath) {
+    int imageFd = -1;
+    bool ok = true;
+    for (const Record& rec : contents.records) {
+        if (rec.type != DISK_WRITE || rec.length < 8) continue;
+        if (imageFd == -1) {
+            imageFd = ::open(imagePath.c_str(), O_WRONLY);
+            if (imageFd < 0) return false;
+        }
+        off_t offset = static_cast<off_t>(getU64(rec.body));
+        size_t length = rec.length - 8;
+        if (::pwrite(imageFd, rec.body + 8, length, offset) != static_cast<ssize_t>(length)) ok = false;
+    }
+    if (imageFd != -1) {
+        if (::fdatasync(imageFd) != 0) ok = false;
+        ::close(imageFd);
+    }
+    return ok;
+}
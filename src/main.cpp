@@ -3,8 +3,20 @@
 #include "fileop.h"
 #include <iostream>
 #include <fstream>
+#include <string>
+
+// 用法：file_system              交互模式
+//       file_system --batch [脚本]  批处理模式，从脚本文件（缺省为标准输入）读取命令
+int main(int argc, char* argv[]) {
+    bool batch = argc > 1 && std::string(argv[1]) == "--batch";
+    static char outputBuffer[1 << 20];
+    if (batch) {
+        // 批处理的输出不与 C stdio 同步，经 1MB 缓冲区成块写出；须在任何输出之前设置
+        std::ios::sync_with_stdio(false);
+        std::cout.rdbuf()->pubsetbuf(outputBuffer, sizeof(outputBuffer));
+        std::cin.tie(nullptr);
+    }
 
-int main() {
     FileSystemContext fsCtx;
     FileOp fileOp(fsCtx);
 
@@ -23,8 +35,19 @@ int main() {
         std::cout << "No existing file system found. You may use `new` to create one.\n";
     }
 
-    // 启动命令行界面
-    fileOp.run();
+    // 启动命令行界面或执行脚本
+    if (!batch) {
+        fileOp.run();
+    } else if (argc > 2 && std::string(argv[2]) != "-") {
+        std::ifstream script(argv[2]);
+        if (!script) {
+            std::cerr << "Cannot open script: " << argv[2] << std::endl;
+            return 1;
+        }
+        fileOp.runBatch(script);
+    } else {
+        fileOp.runBatch(std::cin);
+    }
 
     // 保存虚拟磁盘和元数据
     try {
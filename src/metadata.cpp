@@ -0,0 +1,270 @@
+#include "metadata.h"
+#include "inode_manager.h"
+#include "directory.h"
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace metadata {
+
+namespace {
+
+uint64_t alignUp(uint64_t n) {
+    return (n + SECTION_ALIGN - 1) / SECTION_ALIGN * SECTION_ALIGN;
+}
+
+// inode 表预留约 1/4 的增长空间，新建 inode 时多数检查点仍可原地更新
+uint32_t tableCapacity(int highWater) {
+    return static_cast<uint32_t>(highWater + highWater / 4 + 256);
+}
+
+// 目录树三段依次放在 base 之后，返回末尾位置
+uint64_t layoutTree(Superblock& sb, uint64_t base, size_t dirBytes, size_t entryBytes, size_t stringBytes) {
+    sb.dirOffset = alignUp(base);
+    sb.entryOffset = alignUp(sb.dirOffset + dirBytes);
+    sb.stringOffset = alignUp(sb.entryOffset + entryBytes);
+    return sb.stringOffset + stringBytes;
+}
+
+// 只读映射整个元数据文件：加载时直接从映射区解码，不先清零一块同样大的缓冲区再复制进来
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (::fstat(fd, &st) != 0) return;
+        length = static_cast<size_t>(st.st_size);
+        if (length == 0) return;
+        void* p = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if (p == MAP_FAILED) throw std::runtime_error("Failed to read metadata: " + path);
+        base = static_cast<const char*>(p);
+    }
+    ~MappedFile() {
+        if (base) ::munmap(const_cast<char*>(base), length);
+        if (fd >= 0) ::close(fd);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool opened() const { return fd >= 0; }
+    const char* data() const { return base; }
+    size_t size() const { return base ? length : 0; }
+
+private:
+    int fd = -1;
+    const char* base = nullptr;
+    size_t length = 0;
+};
+
+bool writeAll(int fd, const char* data, size_t length, uint64_t offset) {
+    while (length > 0) {
+        ssize_t n = ::pwrite(fd, data, length, static_cast<off_t>(offset));
+        if (n <= 0) return false;
+        data += n;
+        length -= n;
+        offset += n;
+    }
+    return true;
+}
+
+// 段落在文件范围内且能容纳 count 条 recordSize 字节的记录
+bool sectionFits(uint64_t offset, uint64_t count, uint64_t recordSize, size_t fileSize) {
+    if (offset > fileSize) return false;
+    return count <= (fileSize - offset) / recordSize;
+}
+
+} // namespace
+
+// 超级块布局：0 魔数  8 版本  12 块大小  16 磁盘块数  20 nextInodeId  24 inode 数
+//   28 目录数  32 文件项数  36 字符串表字节数  40/48/56/64 四个段的偏移  72 日志序号
+//   80 inode 表槽位数，其余保留为 0
+void Superblock::encode(char* p) const {
+    std::memset(p, 0, SUPERBLOCK_SIZE);
+    std::memcpy(p, MAGIC, sizeof(MAGIC));
+    putU32(p + 8, version);
+    putU32(p + 12, blockSize);
+    putU32(p + 16, diskBlocks);
+    putU32(p + 20, nextInodeId);
+    putU32(p + 24, inodeCount);
+    putU32(p + 28, dirCount);
+    putU32(p + 32, entryCount);
+    putU32(p + 36, stringBytes);
+    putU64(p + 40, inodeOffset);
+    putU64(p + 48, dirOffset);
+    putU64(p + 56, entryOffset);
+    putU64(p + 64, stringOffset);
+    putU64(p + 72, journalSeq);
+    putU32(p + 80, inodeCapacity);
+}
+
+bool Superblock::decode(const char* p, size_t length) {
+    if (length < SUPERBLOCK_SIZE || std::memcmp(p, MAGIC, sizeof(MAGIC)) != 0) return false;
+    version = getU32(p + 8);
+    blockSize = getU32(p + 12);
+    diskBlocks = getU32(p + 16);
+    nextInodeId = getU32(p + 20);
+    inodeCount = getU32(p + 24);
+    dirCount = getU32(p + 28);
+    entryCount = getU32(p + 32);
+    stringBytes = getU32(p + 36);
+    inodeOffset = getU64(p + 40);
+    dirOffset = getU64(p + 48);
+    entryOffset = getU64(p + 56);
+    stringOffset = getU64(p + 64);
+    journalSeq = getU64(p + 72);
+    inodeCapacity = getU32(p + 80);
+    return true;
+}
+
+bool save(const std::string& path, const InodeManager& inodes, const Directory& root,
+          int blockSize, int diskBlocks, uint64_t journalSeq) {
+    Superblock sb;
+    sb.inodeCapacity = tableCapacity(inodes.highWater());
+    std::vector<char> inodeTable, dirTable, entryTable;
+    std::string strings;
+    inodes.packTable(inodeTable, static_cast<int>(sb.inodeCapacity));
+    root.packTree(dirTable, entryTable, strings);
+
+    sb.blockSize = static_cast<uint32_t>(blockSize);
+    sb.diskBlocks = static_cast<uint32_t>(diskBlocks);
+    sb.nextInodeId = static_cast<uint32_t>(inodes.highWater());
+    sb.journalSeq = journalSeq;
+    sb.inodeCount = static_cast<uint32_t>(inodes.inodeCount());
+    sb.dirCount = static_cast<uint32_t>(dirTable.size() / DIR_RECORD_SIZE);
+    sb.entryCount = static_cast<uint32_t>(entryTable.size() / ENTRY_RECORD_SIZE);
+    sb.stringBytes = static_cast<uint32_t>(strings.size());
+    sb.inodeOffset = alignUp(SUPERBLOCK_SIZE);
+    layoutTree(sb, sb.inodeOffset + inodeTable.size(), dirTable.size(), entryTable.size(), strings.size());
+
+    // 整个文件先在内存中拼好，一次写出
+    std::vector<char> image(sb.stringOffset + strings.size(), 0);
+    sb.encode(image.data());
+    std::memcpy(image.data() + sb.inodeOffset, inodeTable.data(), inodeTable.size());
+    std::memcpy(image.data() + sb.dirOffset, dirTable.data(), dirTable.size());
+    std::memcpy(image.data() + sb.entryOffset, entryTable.data(), entryTable.size());
+    std::memcpy(image.data() + sb.stringOffset, strings.data(), strings.size());
+
+    std::string tmpPath = path + ".tmp";
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    bool ok = writeAll(fd, image.data(), image.size(), 0) && ::fsync(fd) == 0;
+    ::close(fd);
+    if (!ok || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        ::unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool update(const std::string& path, const InodeManager& inodes, const Directory* root,
+            int blockSize, int diskBlocks, uint64_t journalSeq) {
+    int fd = ::open(path.c_str(), O_RDWR);
+    if (fd < 0) return false;
+    char header[SUPERBLOCK_SIZE];
+    Superblock sb;
+    struct stat st;
+    bool ok = ::pread(fd, header, SUPERBLOCK_SIZE, 0) == static_cast<ssize_t>(SUPERBLOCK_SIZE) &&
+              sb.decode(header, SUPERBLOCK_SIZE) && sb.version == VERSION &&
+              sb.blockSize == static_cast<uint32_t>(blockSize) &&
+              sb.diskBlocks == static_cast<uint32_t>(diskBlocks) &&
+              static_cast<uint32_t>(inodes.highWater()) <= sb.inodeCapacity && ::fstat(fd, &st) == 0;
+
+    // 目录树有变化时，新的三段追加在文件末尾；旧的段成为空洞，超过有效内容时改为整体重写
+    std::vector<char> dirTable, entryTable;
+    std::string strings;
+    if (ok && root) {
+        root->packTree(dirTable, entryTable, strings);
+        uint64_t live = sb.inodeOffset + static_cast<uint64_t>(sb.inodeCapacity) * INODE_RECORD_SIZE +
+                        dirTable.size() + entryTable.size() + strings.size();
+        uint64_t end = layoutTree(sb, static_cast<uint64_t>(st.st_size), dirTable.size(), entryTable.size(), strings.size());
+        ok = end <= 2 * live + 4 * SECTION_ALIGN;
+        sb.dirCount = static_cast<uint32_t>(dirTable.size() / DIR_RECORD_SIZE);
+        sb.entryCount = static_cast<uint32_t>(entryTable.size() / ENTRY_RECORD_SIZE);
+        sb.stringBytes = static_cast<uint32_t>(strings.size());
+        ok = ok && writeAll(fd, dirTable.data(), dirTable.size(), sb.dirOffset) &&
+             writeAll(fd, entryTable.data(), entryTable.size(), sb.entryOffset) &&
+             writeAll(fd, strings.data(), strings.size(), sb.stringOffset);
+    }
+
+    // 脏 inode 槽位按 id 排序，相邻槽位合并为一次写入
+    std::vector<int> ids(inodes.dirtySlots());
+    std::sort(ids.begin(), ids.end());
+    std::vector<char> run;
+    for (size_t i = 0; ok && i < ids.size();) {
+        size_t j = i + 1;
+        while (j < ids.size() && ids[j] == ids[j - 1] + 1) ++j;
+        run.resize((j - i) * INODE_RECORD_SIZE);
+        for (size_t k = i; k < j; ++k) {
+            inodes.encodeSlot(ids[k], run.data() + (k - i) * INODE_RECORD_SIZE);
+        }
+        ok = writeAll(fd, run.data(), run.size(), sb.inodeOffset + static_cast<uint64_t>(ids[i]) * INODE_RECORD_SIZE);
+        i = j;
+    }
+
+    // 以上内容落盘后才改写超级块
+    sb.nextInodeId = static_cast<uint32_t>(inodes.highWater());
+    sb.inodeCount = static_cast<uint32_t>(inodes.inodeCount());
+    sb.journalSeq = journalSeq;
+    sb.encode(header);
+    ok = ok && ::fsync(fd) == 0 && writeAll(fd, header, SUPERBLOCK_SIZE, 0) && ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+bool load(const std::string& path, InodeManager& inodes, std::unique_ptr<Directory>& root,
+          int blockSize, int diskBlocks, uint64_t& journalSeq) {
+    MappedFile image(path);
+    if (!image.opened()) return false;
+
+    Superblock sb;
+    if (!sb.decode(image.data(), image.size())) {
+        // 旧版流式格式：inode 表后紧跟递归的目录树
+        std::istringstream legacy(std::string(image.data(), image.size()));
+        inodes.deserialize(legacy);
+        root = std::make_unique<Directory>("/", 0);
+        root->deserialize(legacy);
+        if (!legacy) throw std::runtime_error("Corrupted metadata: " + path);
+        journalSeq = 0;
+        return true;
+    }
+
+    if (sb.version != VERSION && sb.version != 2) {
+        throw std::runtime_error("Unsupported metadata version " + std::to_string(sb.version));
+    }
+    if (sb.blockSize != static_cast<uint32_t>(blockSize) || sb.diskBlocks != static_cast<uint32_t>(diskBlocks)) {
+        throw std::runtime_error("Metadata does not match disk image: " + path);
+    }
+    // 版本 2 的 inode 表只有在用 inode 的记录，按顺序紧排；版本 3 按槽位读取到高水位为止
+    uint32_t inodeRecords = sb.version == 2 ? sb.inodeCount : sb.nextInodeId;
+    if (sb.nextInodeId == 0 || sb.nextInodeId > INT_MAX || sb.inodeCount >= sb.nextInodeId ||
+        (sb.version != 2 && sb.nextInodeId > sb.inodeCapacity) ||
+        !sectionFits(sb.inodeOffset, inodeRecords, INODE_RECORD_SIZE, image.size()) ||
+        !sectionFits(sb.dirOffset, sb.dirCount, DIR_RECORD_SIZE, image.size()) ||
+        !sectionFits(sb.entryOffset, sb.entryCount, ENTRY_RECORD_SIZE, image.size()) ||
+        !sectionFits(sb.stringOffset, sb.stringBytes, 1, image.size())) {
+        throw std::runtime_error("Corrupted metadata: " + path);
+    }
+
+    // 先在临时对象中解析，全部成功后才替换调用方的状态
+    InodeManager table;
+    table.unpackTable(image.data() + sb.inodeOffset, inodeRecords, static_cast<int>(sb.nextInodeId));
+    std::unique_ptr<Directory> tree = Directory::unpackTree(
+        image.data() + sb.dirOffset, sb.dirCount,
+        image.data() + sb.entryOffset, sb.entryCount,
+        std::string_view(image.data() + sb.stringOffset, sb.stringBytes));
+    inodes = std::move(table);
+    root = std::move(tree);
+    journalSeq = sb.journalSeq;
+    return true;
+}
+
+} // namespace metadata
@@ -0,0 +1,132 @@
+#include "session.h"
+
+Session::Session(FileSystemContext& ctx) : fs(ctx) {
+    fs.attach(wd);
+}
+
+Session::~Session() {
+    for (FileSystemContext::OpenFile& file : files) {
+        if (file.inode) fs.close(file);
+    }
+    fs.detach(wd);
+}
+
+void Session::mkdir(const std::string& path) {
+    fs.mkdir(wd, path);
+}
+
+void Session::ls(const std::string& path) {
+    fs.ls(wd, path);
+}
+
+void Session::cd(const std::string& path) {
+    fs.cd(wd, path);
+}
+
+std::string Session::pwd() {
+    return fs.pwd(wd);
+}
+
+void Session::createFile(const std::string& path, const std::string& content) {
+    fs.createFile(wd, path, content);
+}
+
+void Session::readFile(const std::string& path, std::ostream& out) {
+    fs.readFile(wd, path, out);
+}
+
+void Session::streamFile(const std::string& path, const FileSystemContext::ChunkSink& sink) {
+    fs.streamFile(wd, path, sink);
+}
+
+void Session::rm(const std::string& path) {
+    fs.rm(wd, path);
+}
+
+void Session::rmdir(const std::string& path) {
+    fs.rmdir(wd, path);
+}
+
+void Session::removeTree(const std::string& path) {
+    fs.removeTree(wd, path);
+}
+
+void Session::copy(const std::string& src, const std::string& dst) {
+    fs.copy(wd, src, dst);
+}
+
+FileSystemContext::Usage Session::du(const std::string& path) {
+    return fs.du(wd, path);
+}
+
+void Session::mv(const std::string& src, const std::string& dst) {
+    fs.mv(wd, src, dst);
+}
+
+void Session::appendFile(const std::string& path, const std::string& content) {
+    fs.appendFile(wd, path, content);
+}
+
+void Session::overwriteFile(const std::string& path, const std::string& content) {
+    fs.overwriteFile(wd, path, content);
+}
+
+void Session::truncate(const std::string& path, int size) {
+    fs.truncate(wd, path, size);
+}
+
+void Session::importTree(const std::string& hostDir, const std::string& path) {
+    fs.importTree(wd, hostDir, path);
+}
+
+void Session::exportTree(const std::string& path, const std::string& hostDir) {
+    fs.exportTree(wd, path, hostDir);
+}
+
+int Session::open(const std::string& path) {
+    FileSystemContext::OpenFile file;
+    if (!fs.open(wd, path, file)) return -1;
+    int fd;
+    if (!freeFds.empty()) {
+        fd = freeFds.back();
+        freeFds.pop_back();
+    } else {
+        fd = static_cast<int>(files.size());
+        files.emplace_back();
+    }
+    files[fd] = file;
+    return fd;
+}
+
+FileSystemContext::OpenFile* Session::lookup(int fd, const char* op) {
+    if (fd < 0 || fd >= static_cast<int>(files.size()) || !files[fd].inode) {
+        std::cerr << op << " failed: bad file descriptor " << fd << std::endl;
+        return nullptr;
+    }
+    return &files[fd];
+}
+
+int Session::read(int fd, char* buffer, int length) {
+    FileSystemContext::OpenFile* file = lookup(fd, "read");
+    return file ? fs.read(*file, buffer, length) : -1;
+}
+
+int Session::write(int fd, const char* data, int length) {
+    FileSystemContext::OpenFile* file = lookup(fd, "write");
+    return file ? fs.write(*file, data, length) : -1;
+}
+
+int Session::seek(int fd, int offset) {
+    FileSystemContext::OpenFile* file = lookup(fd, "seek");
+    if (!file || offset < 0) return -1;
+    file->offset = offset;
+    return offset;
+}
+
+bool Session::close(int fd) {
+    FileSystemContext::OpenFile* file = lookup(fd, "close");
+    if (!file) return false;
+    fs.close(*file);
+    freeFds.push_back(fd);
+    return true;
+}
@@ -0,0 +1,72 @@
+#include "disk.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <vector>
+
+// 块分配微基准：在不同占用率下测量 allocateBlock 的平均延迟。
+// 每轮随机释放 GROUP 个已占用块，再连续分配 GROUP 个块，占用率保持不变。
+// 只对分配计时，且整组计时一次：逐次读时钟的开销与分配本身相当，会掩盖占用率的影响
+
+static constexpr int GROUP = 256;
+
+static double benchAtFill(int blockCount, int fillPercent, int rounds) {
+    auto dm = std::make_unique<DiskManager>(blockCount);
+    int target = blockCount * fillPercent / 100;
+    if (target < GROUP) target = GROUP;
+
+    std::vector<int> used;
+    for (int i = 0; i < target; ++i) {
+        used.push_back(dm->allocateBlock());
+    }
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> pick(0, used.size() - 1);
+    std::vector<size_t> slots(GROUP);
+    std::chrono::nanoseconds total{0};
+    int groups = rounds / GROUP;
+    for (int r = 0; r < groups; ++r) {
+        for (int i = 0; i < GROUP; ++i) {
+            size_t slot;
+            do {
+                slot = pick(rng);
+            } while (used[slot] == -1);     // 同一组内不重复释放
+            dm->freeBlock(used[slot]);
+            used[slot] = -1;
+            slots[i] = slot;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < GROUP; ++i) {
+            used[slots[i]] = dm->allocateBlock();
+        }
+        total += std::chrono::steady_clock::now() - start;
+
+        for (int i = 0; i < GROUP; ++i) {
+            if (used[slots[i]] == -1) {
+                std::cerr << "allocation failed at fill " << fillPercent << "%" << std::endl;
+                return -1;
+            }
+        }
+    }
+    return static_cast<double>(total.count()) / (static_cast<double>(groups) * GROUP);
+}
+
+int main() {
+    const int blockCount = 64 * 1024;   // 64MB 磁盘
+    const int rounds = 200000;
+    const int fills[] = {0, 25, 50, 75, 90, 95, 99};
+
+    std::cout << "allocateBlock latency, " << blockCount << " blocks, "
+              << rounds << " rounds per fill level\n";
+    std::cout << std::setw(8) << "fill" << std::setw(14) << "ns/alloc" << "\n";
+    for (int fill : fills) {
+        double ns = benchAtFill(blockCount, fill, rounds);
+        if (ns < 0) return 1;
+        std::cout << std::setw(7) << fill << "%" << std::setw(14) << std::fixed
+                  << std::setprecision(1) << ns << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include "fs.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// 检查点基准：64MB 磁盘上 20000 个文件，只改动其中一个文件后比较整体保存与增量检查点的耗时。
+
+int main() {
+    const int blockCount = 65536;
+    const int fileCount = 20000;
+    const std::string image = "bench_checkpoint.dat";
+
+    FileSystemContext fs(blockCount);
+    fs.mkdir("/data");
+    fs.cd("/data");
+    fs.beginBatch();
+    for (int i = 0; i < fileCount; ++i) {
+        fs.createFile("file_" + std::to_string(i) + ".log", std::string(1500, 'a' + i % 26));
+    }
+    fs.endBatch();
+
+    using Clock = std::chrono::steady_clock;
+    auto report = [](const char* phase, Clock::duration d) {
+        std::cout << std::setw(12) << phase << std::setw(12) << std::fixed << std::setprecision(2)
+                  << std::chrono::duration<double, std::milli>(d).count() << " ms\n";
+    };
+
+    std::cout << fileCount << " files on a " << blockCount << "-block disk\n";
+
+    auto start = Clock::now();
+    fs.save(image);
+    report("full", Clock::now() - start);
+
+    fs.appendFile("file_0.log", " changed");
+    start = Clock::now();
+    fs.save(image);
+    report("incremental", Clock::now() - start);
+
+    fs.createFile("new.log", "one more file");
+    start = Clock::now();
+    fs.save(image);
+    report("with tree", Clock::now() - start);
+
+    FileSystemContext loaded(blockCount);
+    loaded.load(image);
+    loaded.cd("/data");
+    loaded.readFile("new.log");
+
+    std::remove(image.c_str());
+    std::remove((image + ".meta").c_str());
+    std::remove((image + ".journal").c_str());
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include "fs.h"
+#include "fileop.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// 命令解析基准：只做切分和查找处理函数，不执行命令。
+// 对比原来的 stringstream 切分 + 逐个比较命令名，与 string_view 切分 + 哈希表查找，
+// 给出每行的耗时和堆分配次数。
+
+static long long allocations = 0;
+
+void* operator new(std::size_t size) {
+    ++allocations;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+static std::vector<std::string> legacySplit(const std::string& str) {
+    std::vector<std::string> result;
+    std::stringstream ss(str);
+    std::string token;
+    while (std::getline(ss, token, ' ')) {
+        if (!token.empty()) result.push_back(token);
+    }
+    return result;
+}
+
+// 与原 executeCommand 的 if/else 链顺序一致，返回命中的分支序号
+static int legacyDispatch(const std::vector<std::string>& tokens) {
+    static const char* const names[] = {"exit", "help", "pwd", "ls", "cd", "mkdir", "rmdir", "create", "read",
+                                        "append", "overwrite", "truncate", "mv", "rm", "save", "load", "mount"};
+    if (tokens.empty()) return -1;
+    for (int i = 0; i < static_cast<int>(sizeof(names) / sizeof(names[0])); ++i) {
+        if (tokens[0] == names[i]) return i;
+    }
+    return -1;
+}
+
+int main() {
+    const int rounds = 200000;
+    const std::vector<std::string> lines = {
+        "ls", "cd /home/user/projects", "create notes.txt hello", "read notes.txt",
+        "append notes.txt more", "mv /home/user/notes.txt /tmp/notes.txt", "rm /tmp/notes.txt",
+        "mount vdisk_final.dat 256", "truncate notes.txt 16", "unknown command here"};
+
+    FileSystemContext fs;
+    FileOp op(fs);
+    long long hits = 0;
+
+    using Clock = std::chrono::steady_clock;
+    auto measure = [&](const char* name, auto parse) {
+        long long before = allocations;
+        auto start = Clock::now();
+        for (int r = 0; r < rounds; ++r) {
+            for (const std::string& line : lines) hits += parse(line);
+        }
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        double calls = static_cast<double>(rounds) * lines.size();
+        std::cout << std::setw(10) << name << std::setw(10) << std::fixed << std::setprecision(1) << ns / calls
+                  << " ns/line" << std::setw(10) << std::setprecision(2) << (allocations - before) / calls
+                  << " allocs/line" << std::setw(10) << std::setprecision(2) << calls / ns * 1000
+                  << " M lines/s\n";
+    };
+
+    measure("legacy", [](const std::string& line) { return legacyDispatch(legacySplit(line)) >= 0 ? 1 : 0; });
+    measure("table", [&](const std::string& line) {
+        FileOp::Args args;
+        FileOp::tokenize(line, args);
+        return args.size() > 0 && op.findCommand(args[0]) ? 1 : 0;
+    });
+    return hits > 0 ? 0 : 1;
+}
@@ -0,0 +1,40 @@
+#include "fs.h"
+#include "session.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+
+// 描述符基准：在较深的目录中对同一个文件做 100000 次小追加，比较按路径操作与经描述符写入的耗时。
+
+int main() {
+    const int writes = 100000;
+    const std::string dir = "/a/b/c/d/e/f";
+    const std::string record = "0123456789abcdef";
+
+    FileSystemContext fs(16384);
+    Session s(fs);
+    s.mkdir(dir);
+    s.createFile(dir + "/by_path.log", "");
+    s.createFile(dir + "/by_fd.log", "");
+
+    using Clock = std::chrono::steady_clock;
+    auto report = [&](const char* phase, Clock::duration d) {
+        double us = std::chrono::duration<double, std::micro>(d).count();
+        std::cout << std::setw(8) << phase << std::setw(12) << std::fixed << std::setprecision(3)
+                  << us / writes << " us/write\n";
+    };
+
+    fs.beginBatch();
+    auto start = Clock::now();
+    for (int i = 0; i < writes; ++i) s.appendFile(dir + "/by_path.log", record);
+    report("path", Clock::now() - start);
+
+    int fd = s.open(dir + "/by_fd.log");
+    start = Clock::now();
+    for (int i = 0; i < writes; ++i) s.write(fd, record.data(), static_cast<int>(record.size()));
+    report("fd", Clock::now() - start);
+    s.close(fd);
+    fs.endBatch();
+    return 0;
+}
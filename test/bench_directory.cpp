@@ -0,0 +1,60 @@
+#include "directory.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// 大目录基准：在同一目录中创建、查找、删除 100k 个文件项。
+
+int main() {
+    const int count = 100000;
+    std::vector<std::string> names;
+    names.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        names.push_back("file_" + std::to_string(i) + ".log");
+    }
+
+    Directory dir("big", 1);
+    using Clock = std::chrono::steady_clock;
+    auto report = [&](const char* phase, Clock::duration d) {
+        double ms = std::chrono::duration<double, std::milli>(d).count();
+        std::cout << std::setw(8) << phase << std::setw(12) << std::fixed << std::setprecision(2)
+                  << ms << " ms" << std::setw(12) << std::setprecision(1)
+                  << ms * 1e6 / count << " ns/op\n";
+    };
+
+    std::cout << count << " entries in one directory\n";
+
+    auto start = Clock::now();
+    for (int i = 0; i < count; ++i) {
+        dir.addFile(names[i], i + 2);
+    }
+    report("create", Clock::now() - start);
+
+    start = Clock::now();
+    long long sum = 0;
+    for (int i = count - 1; i >= 0; --i) {
+        sum += dir.findFile(names[i]);
+    }
+    report("lookup", Clock::now() - start);
+    if (sum != static_cast<long long>(count) * (count + 3) / 2) {
+        std::cerr << "lookup returned wrong inodes" << std::endl;
+        return 1;
+    }
+
+    start = Clock::now();
+    for (int i = 0; i < count; i += 2) {
+        dir.removeFile(names[i]);
+    }
+    for (int i = 1; i < count; i += 2) {
+        dir.removeFile(names[i]);
+    }
+    report("delete", Clock::now() - start);
+
+    if (!dir.isDirEmpty()) {
+        std::cerr << "directory not empty after deleting all entries" << std::endl;
+        return 1;
+    }
+    return 0;
+}
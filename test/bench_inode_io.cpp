@@ -0,0 +1,81 @@
+#include "inode.h"
+#include "disk.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <new>
+#include <string>
+#include <string_view>
+
+// Inode 读写热路径基准：用替换全局 operator new 的计数钩子统计每次调用的堆分配次数，
+// 同时给出每次调用的耗时。预热一轮后，读、原位覆盖、流式读取和等长重写都应为 0 次分配。
+
+static long long allocations = 0;
+
+void* operator new(std::size_t size) {
+    ++allocations;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+template <typename Fn>
+static bool measure(const char* name, int calls, Fn fn) {
+    fn();   // 预热：块映射缓存等一次性的分配
+    long long before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; ++i) fn();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    double perCall = static_cast<double>(allocations - before) / calls;
+    std::cout << std::setw(12) << name << std::setw(12) << std::fixed << std::setprecision(1) << ns / calls
+              << " ns" << std::setw(10) << std::setprecision(2) << perCall << " allocs/call\n";
+    return allocations == before;
+}
+
+// 在 disk 上依次测量各操作，返回是否全部为 0 次分配
+static bool run(DiskManager& disk) {
+    const int calls = 20000;
+    const int fileSize = 64 * DiskManager::BLOCK_SIZE;
+    Inode inode;
+    std::string payload(fileSize, 'x');
+    inode.writeData(disk, payload);
+    std::string buffer(fileSize, '\0');
+    std::string_view record("0123456789abcdef0123456789abcdef");
+
+    bool ok = true;
+    ok &= measure("read", calls, [&] { inode.read(disk, 0, fileSize, &buffer[0]); });
+    ok &= measure("readStream", calls, [&] {
+        long long sum = 0;
+        inode.readStream(disk, 0, fileSize, [&](const char* data, int n) { sum += data[n - 1]; });
+    });
+    ok &= measure("overwrite", calls, [&] { inode.write(disk, 4000, record); });
+    ok &= measure("writeData", calls / 10, [&] { inode.writeData(disk, payload); });
+    return ok;
+}
+
+int main() {
+    std::cout << "[memory]" << std::endl;
+    DiskManager disk(4096);
+    bool ok = run(disk);
+
+    // 缓存模式：容量足以容纳整个文件，预热后全部命中，逐块经栈上的临时区交出
+    std::cout << "[cached]" << std::endl;
+    const std::string image = "vdisk_bench_io.dat";
+    DiskManager cached(4096);
+    if (!cached.openCached(image, 256, 4096)) return 1;
+    ok &= run(cached);
+    cached.closeImage();
+    std::remove(image.c_str());
+
+    std::cout << (ok ? "zero allocations per call" : "hot path allocates") << std::endl;
+    return ok ? 0 : 1;
+}
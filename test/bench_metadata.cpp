@@ -0,0 +1,56 @@
+#include "metadata.h"
+#include "inode_manager.h"
+#include "directory.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// 元数据基准：1000 个目录、每个目录 1000 个文件，共 1M 个目录项的保存与加载。
+
+int main() {
+    const int dirCount = 1000;
+    const int filesPerDir = 1000;
+    const std::string path = "bench_metadata.meta";
+
+    InodeManager inodes;
+    auto root = std::make_unique<Directory>("", inodes.allocateInode(Inode::DIRECTORY));
+    for (int d = 0; d < dirCount; ++d) {
+        Directory* dir = root->addSubdir("dir_" + std::to_string(d), inodes.allocateInode(Inode::DIRECTORY));
+        for (int f = 0; f < filesPerDir; ++f) {
+            dir->addFile("file_" + std::to_string(f) + ".log", inodes.allocateInode(Inode::FILE));
+        }
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto report = [](const char* phase, Clock::duration d) {
+        std::cout << std::setw(8) << phase << std::setw(12) << std::fixed << std::setprecision(2)
+                  << std::chrono::duration<double, std::milli>(d).count() << " ms\n";
+    };
+
+    std::cout << dirCount * filesPerDir << " entries in " << dirCount << " directories\n";
+
+    auto start = Clock::now();
+    if (!metadata::save(path, inodes, *root, 1024, 1024)) {
+        std::cerr << "save failed" << std::endl;
+        return 1;
+    }
+    report("save", Clock::now() - start);
+
+    InodeManager loadedInodes;
+    std::unique_ptr<Directory> loadedRoot;
+    uint64_t journalSeq;
+    start = Clock::now();
+    metadata::load(path, loadedInodes, loadedRoot, 1024, 1024, journalSeq);
+    report("load", Clock::now() - start);
+    std::remove(path.c_str());
+
+    Directory* last = loadedRoot->findSubdir("dir_" + std::to_string(dirCount - 1));
+    if (loadedInodes.inodeCount() != inodes.inodeCount() || !last ||
+        last->findFile("file_999.log") != dirCount * (filesPerDir + 1) + 1) {
+        std::cerr << "loaded tree does not match" << std::endl;
+        return 1;
+    }
+    return 0;
+}
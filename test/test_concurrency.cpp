@@ -0,0 +1,226 @@
+#include "fs.h"
+#include "session.h"
+#include "metadata.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+// 多线程测试：先让多个线程在各自目录和一个共享目录中并发创建、追加、读取、删除和移动文件，
+// 同时另有线程反复建删目录和保存，最后从保存的元数据核对结果；然后让大量会话分摊在几个线程上，
+// 各自 cd 到自己的目录按相对路径读写；最后核对并发读的内容，再单独测量并发读不同文件的吞吐量。
+
+namespace {
+
+const int THREADS = 8;
+const int FILES_PER_THREAD = 200;
+
+std::string fileName(int k) {
+    return "f" + std::to_string(k);
+}
+
+std::string content(int t, int k) {
+    return "t" + std::to_string(t) + "-" + std::to_string(k);
+}
+
+bool removed(int k) { return k % 3 == 0; }
+bool moved(int k) { return !removed(k) && k % 5 == 1; }
+
+} // namespace
+
+int main() {
+    std::cout << "[concurrent stress]" << std::endl;
+    const std::string image = "vdisk_concurrency.dat";
+    std::atomic<int> mismatches{0};
+    {
+        FileSystemContext fs(16384);
+        fs.save(image);
+        fs.mkdir("/shared");
+
+        std::vector<std::thread> workers;
+        for (int t = 0; t < THREADS; ++t) {
+            workers.emplace_back([&, t] {
+                std::string dir = "/w" + std::to_string(t) + "/";
+                fs.mkdir(dir);
+                for (int k = 0; k < FILES_PER_THREAD; ++k) {
+                    std::string path = dir + fileName(k);
+                    fs.createFile(path, content(t, k));
+                    fs.appendFile(path, " x");
+                    std::ostringstream out;
+                    fs.readFile(path, out);
+                    if (out.str().find(content(t, k) + " x") == std::string::npos) ++mismatches;
+                    if (removed(k)) fs.rm(path);
+                    else if (moved(k)) fs.mv(path, "/shared/w" + std::to_string(t) + "_" + fileName(k));
+                }
+            });
+        }
+        workers.emplace_back([&] {
+            for (int i = 0; i < 100; ++i) {
+                fs.mkdir("/churn/" + std::to_string(i));
+                fs.rmdir("/churn/" + std::to_string(i));
+            }
+        });
+        workers.emplace_back([&] {
+            for (int i = 0; i < 5; ++i) {
+                fs.save(image);
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        });
+        for (std::thread& worker : workers) worker.join();
+        fs.save(image);
+    }
+    if (mismatches != 0) {
+        std::cerr << mismatches << " reads returned wrong content" << std::endl;
+        return 1;
+    }
+
+    InodeManager inodes;
+    std::unique_ptr<Directory> tree;
+    uint64_t seq = 0;
+    metadata::load(image + ".meta", inodes, tree, DiskManager::BLOCK_SIZE, 16384, seq);
+    Directory* shared = tree->findSubdir("shared");
+    int expectedFiles = 0;
+    for (int t = 0; t < THREADS; ++t) {
+        Directory* dir = tree->findSubdir("w" + std::to_string(t));
+        for (int k = 0; k < FILES_PER_THREAD && dir && shared; ++k) {
+            int inDir = dir->findFile(fileName(k));
+            int inShared = shared->findFile("w" + std::to_string(t) + "_" + fileName(k));
+            int id = moved(k) ? inShared : inDir;
+            Inode* node = inodes.getInode(id);
+            bool ok = removed(k) ? (inDir == -1 && inShared == -1)
+                                 : (node && node->size == static_cast<int>(content(t, k).size()) + 3 &&
+                                    (moved(k) ? inDir == -1 : inShared == -1));
+            if (!ok) ++mismatches;
+            if (!removed(k)) ++expectedFiles;
+        }
+        if (!dir) ++mismatches;
+    }
+    // 根目录、/shared、/churn、各线程目录和留下的文件
+    int expectedInodes = 3 + THREADS + expectedFiles;
+    std::cout << "inodes: " << inodes.inodeCount() << ", expected: " << expectedInodes << std::endl;
+    if (!shared || mismatches != 0 || inodes.inodeCount() != expectedInodes) {
+        std::cerr << "concurrent stress mismatch" << std::endl;
+        return 1;
+    }
+    std::remove(image.c_str());
+    std::remove((image + ".meta").c_str());
+    std::remove((image + ".journal").c_str());
+
+    // 会话：每个会话有自己的工作目录，cd 互不影响
+    std::cout << "[sessions]" << std::endl;
+    {
+        FileSystemContext fs(8192);
+        const int sessionCount = 1000;
+        std::vector<std::unique_ptr<Session>> sessions;
+        for (int i = 0; i < sessionCount; ++i) sessions.push_back(std::make_unique<Session>(fs));
+        std::vector<std::thread> workers;
+        for (int t = 0; t < THREADS; ++t) {
+            workers.emplace_back([&, t] {
+                for (int i = t; i < sessionCount; i += THREADS) {
+                    Session& s = *sessions[i];
+                    std::string dir = "/s/" + std::to_string(i);
+                    s.mkdir(dir);
+                    s.cd(dir);
+                    s.createFile("note", "session " + std::to_string(i));
+                }
+                // 各会话轮流执行，工作目录不能被其他会话的 cd 改掉
+                for (int i = t; i < sessionCount; i += THREADS) {
+                    Session& s = *sessions[i];
+                    std::ostringstream out;
+                    s.readFile("note", out);
+                    if (s.pwd() != "/s/" + std::to_string(i) ||
+                        out.str().find("session " + std::to_string(i)) == std::string::npos) {
+                        ++mismatches;
+                    }
+                }
+            });
+        }
+        for (std::thread& worker : workers) worker.join();
+
+        // 其他会话的工作目录不能删除，会话结束后才可以
+        Session admin(fs);
+        admin.rm("/s/7/note");
+        admin.rmdir("/s/7");
+        bool kept = sessions[7]->pwd() == "/s/7";
+        sessions[7].reset();
+        admin.rmdir("/s/7");
+        admin.cd("/s/7");   // 目录已删除，cd 失败
+        bool gone = admin.pwd() == "/";
+
+        // 加载新镜像后旧的工作目录作废，会话回到根目录
+        fs.save(image);
+        fs.load(image);
+        bool reset = sessions[3]->pwd() == "/" && admin.pwd() == "/";
+        std::ostringstream out;
+        sessions[3]->readFile("/s/3/note", out);
+        if (mismatches != 0 || !kept || !gone || !reset || out.str().find("session 3") == std::string::npos) {
+            std::cerr << "session mismatch" << std::endl;
+            return 1;
+        }
+    }
+    std::remove(image.c_str());
+    std::remove((image + ".meta").c_str());
+    std::remove((image + ".journal").c_str());
+
+    // 并发读正确性：各线程同时读不同的文件，内容逐字节核对；与下面的吞吐量测量分开，不计时
+    std::cout << "[concurrent reads]" << std::endl;
+    FileSystemContext fs(8192);
+    const int fileCount = 64;
+    const int readsPerThread = 20000;
+    auto fileData = [](int i) { return std::string(4000, static_cast<char>('a' + i % 26)); };
+    for (int i = 0; i < fileCount; ++i) {
+        fs.createFile("/data" + std::to_string(i), fileData(i));
+    }
+    {
+        std::atomic<int> wrong{0};
+        std::vector<std::thread> readers;
+        for (int t = 0; t < THREADS; ++t) {
+            readers.emplace_back([&, t] {
+                for (int n = 0; n < fileCount; ++n) {
+                    int i = (t * 8 + n) % fileCount;
+                    std::string got;
+                    fs.streamFile("/data" + std::to_string(i), [&](const char* data, int len) { got.append(data, len); });
+                    if (got != fileData(i) + '\0') ++wrong;
+                }
+            });
+        }
+        for (std::thread& reader : readers) reader.join();
+        if (wrong != 0) {
+            std::cerr << wrong << " concurrent reads returned wrong content" << std::endl;
+            return 1;
+        }
+    }
+
+    // 并发读吞吐量：每个线程读不同的文件，只报告数字，不作为通过条件。
+    // 线程数超过硬件线程数时的加速比只反映调度与争用，不代表可扩展性
+    std::cout << "[read throughput]" << std::endl;
+    unsigned hardware = std::thread::hardware_concurrency();
+    std::cout << "hardware threads: " << hardware << std::endl;
+    using Clock = std::chrono::steady_clock;
+    double baseline = 0;
+    for (int threads = 1; threads <= THREADS; threads *= 2) {
+        std::vector<std::thread> readers;
+        auto start = Clock::now();
+        for (int t = 0; t < threads; ++t) {
+            readers.emplace_back([&, t] {
+                std::ostream sink(nullptr);   // 丢弃输出，只测读取路径
+                for (int n = 0; n < readsPerThread; ++n) {
+                    fs.readFile("/data" + std::to_string((t * 8 + n) % fileCount), sink);
+                }
+            });
+        }
+        for (std::thread& reader : readers) reader.join();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        double rate = threads * readsPerThread / seconds;
+        if (threads == 1) baseline = rate;
+        std::cout << std::setw(2) << threads << " threads" << std::setw(12) << std::fixed << std::setprecision(0)
+                  << rate << " reads/s" << std::setw(8) << std::setprecision(2) << rate / baseline << "x"
+                  << (hardware != 0 && static_cast<unsigned>(threads) > hardware ? "  (oversubscribed)" : "") << '\n';
+    }
+    return 0;
+}
@@ -1,5 +1,7 @@
 #include "disk.h"
 #include <iostream>
+#include <cstdio>
+#include <cstring>
 
 int main() {
     DiskManager dm;
@@ -40,5 +42,127 @@ int main() {
     dm2.freeBlock(block2);
     std::cout << "Freed blocks: " << block1 << ", " << block2 << std::endl;
 
+    // 测试连续块分配
+    int ext = dm2.allocateExtent(16);
+    if (ext == -1) {
+        std::cout << "Failed to allocate extent." << std::endl;
+        return 1;
+    }
+    std::cout << "Allocated extent: [" << ext << ", " << ext + 15 << "]" << std::endl;
+
+    std::string pattern(16 * DiskManager::BLOCK_SIZE, 'x');
+    dm2.writeBlocks(ext, 0, pattern.size(), pattern.data());
+    std::string check(pattern.size(), '\0');
+    dm2.readBlocks(ext, 0, check.size(), &check[0]);
+    std::cout << "Extent round trip: " << (check == pattern ? "OK" : "MISMATCH") << std::endl;
+    if (check != pattern) return 1;
+
+    // 测试 mmap 模式：新建镜像，写入后刷回，再重新映射验证
+    std::remove("vdisk_mmap.dat");
+    {
+        DiskManager mapped;
+        if (!mapped.mapDisk("vdisk_mmap.dat", 256)) {
+            std::cout << "Failed to map disk image." << std::endl;
+            return 1;
+        }
+        int blk = mapped.allocateBlock();
+        mapped.writeBlocks(blk, 0, 15, "Hello, mmap!!!");
+        mapped.sync();
+        std::cout << "Mapped block " << blk << " written and synced" << std::endl;
+    }
+    DiskManager remapped;
+    if (!remapped.mapDisk("vdisk_mmap.dat")) {
+        std::cout << "Failed to remap disk image." << std::endl;
+        return 1;
+    }
+    char text[15] = {0};
+    remapped.readBlocks(0, 0, sizeof(text), text);
+    std::cout << "Remapped " << remapped.getBlockCount() << " blocks, block 0 allocated: "
+              << (remapped.isAllocated(0) ? "yes" : "no") << ", content: " << text << std::endl;
+    if (!remapped.isAllocated(0) || std::string(text) != "Hello, mmap!!!") return 1;
+    remapped.closeImage();
+
+    // 测试缓存模式：缓存只有 8 帧，写入 64 个块会触发淘汰与写回
+    std::remove("vdisk_cache.dat");
+    {
+        DiskManager cached;
+        if (!cached.openCached("vdisk_cache.dat", 8, 256)) {
+            std::cout << "Failed to open cached disk image." << std::endl;
+            return 1;
+        }
+        int start = cached.allocateExtent(64);
+        for (int i = 0; i < 64; ++i) {
+            std::string line = "block " + std::to_string(start + i);
+            cached.writeBlocks(start + i, 0, line.size() + 1, line.c_str());
+        }
+        cached.sync();
+        const BlockCache::Stats& st = cached.getCache()->stats();
+        std::cout << "Cache stats: hits " << st.hits << ", misses " << st.misses
+                  << ", evictions " << st.evictions << ", writebacks " << st.writebacks << std::endl;
+    }
+    DiskManager reopened;
+    reopened.openCached("vdisk_cache.dat", 8);
+    char line[16] = {0};
+    reopened.readBlocks(42, 0, sizeof(line), line);
+    std::cout << "Reopened cached disk, block 42: " << line << std::endl;
+    if (std::string(line) != "block 42") return 1;
+
+    // 延迟清零：释放的块不擦除，重新分配后读出的仍是 0；部分写入的块其余部分为 0
+    {
+        DiskManager lazy(64);
+        int blk = lazy.allocateBlock();
+        std::string junk(DiskManager::BLOCK_SIZE, 'j');
+        lazy.writeBlocks(blk, 0, junk.size(), junk.data());
+        lazy.freeBlock(blk);
+        bool kept = lazy.getBlockCount() > 0 && std::memcmp(lazy.getBlock(blk), junk.data(), 4) == 0;
+        int again = lazy.allocateBlock();
+        lazy.writeBlocks(again, 10, 3, "abc");
+        std::string back(DiskManager::BLOCK_SIZE, 'x');
+        lazy.readBlocks(again, 0, back.size(), &back[0]);
+        std::string expected(DiskManager::BLOCK_SIZE, '\0');
+        expected.replace(10, 3, "abc");
+        int untouched = lazy.allocateBlock();
+        lazy.saveDisk("vdisk_lazy.dat");
+        DiskManager lazyLoaded(64);
+        lazyLoaded.loadDisk("vdisk_lazy.dat");
+        bool zeroOnDisk = lazyLoaded.getBlock(untouched)[0] == 0 && lazyLoaded.getBlock(untouched)[1023] == 0;
+
+        // 安全擦除：释放时立即清零
+        lazy.setSecureErase(true);
+        lazy.freeBlock(again);
+        bool erased = lazy.getBlock(again)[10] == 0;
+        std::remove("vdisk_lazy.dat");
+        std::cout << "Lazy zero-fill: " << (again == blk && back == expected && zeroOnDisk ? "OK" : "MISMATCH")
+                  << ", secure erase: " << (erased ? "OK" : "MISMATCH") << std::endl;
+        if (!kept || again != blk || back != expected || !zeroOnDisk || !erased) return 1;
+    }
+
+    // 整段释放跨越分片边界；其中已空闲的块不重复计数
+    {
+        DiskManager runs(8192);
+        int start = runs.allocateExtent(3000);
+        runs.freeBlock(start + 10);
+        runs.freeExtent(start, 3000);
+        bool ok = start != -1 && runs.freeBlockCount() == 8192 && !runs.isAllocated(start + 2999) &&
+                  runs.allocateExtent(8192) == 0;
+        std::cout << "freeExtent: " << (ok ? "OK" : "MISMATCH") << std::endl;
+        if (!ok) return 1;
+    }
+
+    // 快照引用的块：释放后仍占用、但不算当前文件系统的块；重新使用或最后一个引用释放后恢复
+    {
+        DiskManager shared(256);
+        int blk = shared.allocateExtent(4);
+        for (int i = 0; i < 4; ++i) shared.shareBlock(blk + i);
+        shared.freeExtent(blk, 4);
+        bool held = shared.freeBlockCount() == 252 && shared.isAllocated(blk) && !shared.isLive(blk);
+        shared.adoptBlock(blk);
+        for (int i = 0; i < 4; ++i) shared.unshareBlock(blk + i);
+        bool ok = held && shared.isLive(blk) && !shared.isShared(blk) && !shared.hasShared() &&
+                  shared.freeBlockCount() == 255 && !shared.isAllocated(blk + 3);
+        std::cout << "Snapshot sharing: " << (ok ? "OK" : "MISMATCH") << std::endl;
+        if (!ok) return 1;
+    }
+
     return 0;
 }
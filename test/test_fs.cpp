@@ -1,5 +1,14 @@
 #include "fs.h"
+#include "session.h"
+#include "fileop.h"
+#include "metadata.h"
 #include <iostream>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <memory>
+#include <vector>
 
 int main() {
     FileSystemContext fs;
@@ -57,5 +66,428 @@ int main() {
 
     std::cout << "[pwd] => " << fs.pwd() << std::endl;
 
+    // 命令切分：制表符和 Windows 换行留下的 \r 与空格同样作为分隔符
+    std::cout << "[command tokenizer]" << std::endl;
+    {
+        FileOp::Args args;
+        FileOp::tokenize("create\t/f  a\r", args);
+        bool ok = args.size() == 3 && args[0] == "create" && args[1] == "/f" && args[2] == "a";
+        FileOp::tokenize(" \t\r", args);
+        if (!ok || args.size() != 0) {
+            std::cerr << "tokenizer mismatch" << std::endl;
+            return 1;
+        }
+    }
+
+    // 批处理脚本：注释、空白行和 Windows 换行被跳过，exit 之后的命令不执行；报告按命令汇总
+    std::cout << "[batch script]" << std::endl;
+    {
+        std::istringstream script(
+            "# build a small tree\r\n"
+            "\r\n"
+            "mkdir /batch/a\r\n"
+            "create /batch/a/f.txt hello\r\n"
+            "   \t\n"
+            "mkdir /batch/b\n"
+            "exit\n"
+            "mkdir /batch/never\n");
+        std::ostringstream report;
+        FileOp op(fs);
+        op.runBatch(script, report);
+
+        std::string f;
+        fs.streamFile("/batch/a/f.txt", [&](const char* data, int n) { f.append(data, n); });
+        FileSystemContext::Usage usage = fs.du("/batch");
+        bool tree = usage.dirs == 3 && usage.files == 1 && f == std::string("hello") + '\0' &&
+                    fs.du("/batch/never").dirs == 0;
+
+        // 表头、每类命令一行（按名字排序），最后是总数
+        std::istringstream lines(report.str());
+        std::string header, first, second, total, extra;
+        std::getline(lines, header);
+        std::getline(lines, first);
+        std::getline(lines, second);
+        std::getline(lines, total);
+        auto row = [](const std::string& text, std::string& name, long long& count) {
+            std::istringstream in(text);
+            return static_cast<bool>(in >> name >> count);
+        };
+        std::string name1, name2;
+        long long count1 = 0, count2 = 0;
+        bool rows = header.rfind("command", 0) == 0 && row(first, name1, count1) && row(second, name2, count2) &&
+                    name1 == "create" && count1 == 1 && name2 == "mkdir" && count2 == 2 &&
+                    total.rfind("3 commands in ", 0) == 0 && !std::getline(lines, extra);
+        fs.removeTree("/batch");
+        if (!tree || !rows) {
+            std::cerr << "batch script mismatch" << std::endl << report.str();
+            return 1;
+        }
+    }
+
+    // 缺少操作数：rm -r、cp -r 和 snapshot -d 只给出选项时打印用法，不把选项当作路径
+    std::cout << "[missing operands]" << std::endl;
+    {
+        FileOp op(fs);
+        std::ostringstream out;
+        std::streambuf* saved = std::cout.rdbuf(out.rdbuf());
+        op.executeCommand("rm -r");
+        op.executeCommand("cp -r /x");
+        op.executeCommand("snapshot -d");
+        std::cout.rdbuf(saved);
+        if (out.str() != "Usage: rm [-r] <path>\nUsage: cp [-r] <src> <dst>\nUsage: snapshot [-d] <name>\n") {
+            std::cerr << "usage mismatch: " << out.str() << std::endl;
+            return 1;
+        }
+    }
+
+    // 文件描述符：打开后按位置读写，不再解析路径；打开期间文件不能删除
+    std::cout << "[descriptors]" << std::endl;
+    {
+        Session s(fs);
+        s.createFile("/big.bin", "");
+        int fd = s.open("/big.bin");
+        const std::string chunk(1000, 'z');
+        for (int i = 0; i < 100; ++i) s.write(fd, chunk.data(), static_cast<int>(chunk.size()));
+        s.seek(fd, 0);
+        s.write(fd, "head", 4);
+        char buf[16] = {0};
+        s.seek(fd, 0);
+        int first = s.read(fd, buf, 6);
+        bool head = first == 6 && std::string(buf, 6) == "headzz";
+        s.seek(fd, 99995);
+        int tail = s.read(fd, buf, sizeof(buf));
+        // 等长覆盖沿用原来的块；截短后加长的部分读出为 0
+        s.createFile("/conf", "key=1");
+        s.overwriteFile("/conf", "key=2");
+        s.truncate("/conf", 3);
+        s.truncate("/conf", 8);
+        std::string conf;
+        s.streamFile("/conf", [&](const char* data, int n) { conf.append(data, n); });
+        if (conf != std::string("key\0\0\0\0\0", 8)) {
+            std::cerr << "truncate mismatch" << std::endl;
+            return 1;
+        }
+        long long streamed = 0;
+        s.streamFile("/big.bin", [&](const char*, int n) { streamed += n; });
+        s.rm("/big.bin");              // 仍在打开，删除被拒绝
+        bool kept = s.close(fd) && s.open("/big.bin") == fd;
+        s.close(fd);
+        s.rm("/big.bin");
+        if (!head || tail != 5 || streamed != 100000 || !kept || s.open("/big.bin") != -1 || s.read(fd, buf, 1) != -1) {
+            std::cerr << "descriptor mismatch" << std::endl;
+            return 1;
+        }
+    }
+
+    // 整棵目录树的复制、用量统计与递归删除
+    std::cout << "[tree operations]" << std::endl;
+    {
+        Session s(fs);
+        s.mkdir("/t/a/b");
+        s.createFile("/t/x.txt", "xxxx");
+        s.createFile("/t/a/b/y.txt", std::string(3000, 'y'));
+        FileSystemContext::Usage before = s.du("/t");
+        s.copy("/t", "/t2");
+        s.copy("/t", "/t/a");              // 复制到自身子树中，被拒绝
+        s.copy("/t/x.txt", "/t2/a");       // 复制到已有目录中
+        s.copy("/t/x.txt", "/");           // 复制到根目录中
+        s.copy("/t/a", "/");
+        bool intoRoot = s.du("/x.txt").files == 1 && s.du("/a/b").files == 1;
+        s.rm("/x.txt");
+        s.removeTree("/a");
+        FileSystemContext::Usage copied = s.du("/t2");
+        std::string y;
+        s.streamFile("/t2/a/b/y.txt", [&](const char* data, int n) { y.append(data, n); });
+
+        s.cd("/t2/a/b");
+        s.removeTree("/t2");               // 子树中有工作目录，什么也不删
+        bool kept = s.du("/t2").files == 3;
+        s.cd("/");
+        int fd = s.open("/t2/x.txt");
+        s.removeTree("/t2");               // 子树中有打开的文件
+        kept = kept && s.du("/t2").files == 3;
+        s.close(fd);
+        s.removeTree("/t2");
+        s.removeTree("/t");
+        bool ok = before.files == 2 && before.dirs == 3 && before.bytes == 5 + 3001 &&
+                  copied.files == 3 && copied.dirs == 3 && y == std::string(3000, 'y') + '\0' &&
+                  kept && intoRoot && s.du("/t2").dirs == 0 && s.du("/t").dirs == 0;
+        if (!ok) {
+            std::cerr << "tree operation mismatch" << std::endl;
+            return 1;
+        }
+    }
+
+    // 移动目录后，子树中每一层的路径和落在其中的工作目录都换成新路径
+    std::cout << "[move directory paths]" << std::endl;
+    {
+        fs.mkdir("/m/a/b/c");
+        fs.mkdir("/m/a/b2");
+        fs.mkdir("/n");
+        const char* inside[] = {"/m/a", "/m/a/b", "/m/a/b/c", "/m/a/b2"};
+        const char* moved[] = {"/n/z", "/n/z/b", "/n/z/b/c", "/n/z/b2"};
+        std::vector<std::unique_ptr<Session>> sessions;
+        for (const char* path : inside) {
+            sessions.push_back(std::make_unique<Session>(fs));
+            sessions.back()->cd(path);
+        }
+        fs.cd("/m/a/b/c");
+        fs.mv("/m/a", "/n/z");
+        bool ok = fs.pwd() == "/n/z/b/c";
+        for (size_t i = 0; i < sessions.size(); ++i) {
+            ok = ok && sessions[i]->pwd() == moved[i];
+        }
+        fs.cd("/");
+        sessions.clear();
+        fs.removeTree("/n");
+        fs.removeTree("/m");
+        if (!ok) {
+            std::cerr << "moved path mismatch" << std::endl;
+            return 1;
+        }
+    }
+
+    // 路径缓存：缓存过的路径在目录删除或移走、再重新创建后，必须解析到新的目录
+    std::cout << "[dentry cache]" << std::endl;
+    {
+        fs.mkdir("/p/q");
+        fs.du("/p/q");                       // 填入缓存
+        fs.mv("/p", "/p_old");
+        bool movedAway = fs.du("/p/q").dirs == 0;
+        fs.mkdir("/p/q");
+        fs.createFile("/p/q/x.txt", "x");
+        bool moved = fs.du("/p/q").files == 1 && fs.du("/p_old/q").files == 0;
+
+        fs.mkdir("/r/s");
+        fs.du("/r/s");
+        fs.rmdir("/r/s");
+        bool removed = fs.du("/r/s").dirs == 0;
+        fs.mkdir("/r/s");
+        fs.createFile("/r/s/y.txt", "y");
+        fs.du("/r");
+        fs.removeTree("/r");
+        bool tree = fs.du("/r/s").dirs == 0 && fs.du("/r").dirs == 0;
+        fs.mkdir("/r/s");
+        tree = tree && fs.du("/r/s").dirs == 1 && fs.du("/r/s").files == 0;
+
+        fs.removeTree("/p");
+        fs.removeTree("/p_old");
+        fs.removeTree("/r");
+        if (!movedAway || !moved || !removed || !tree) {
+            std::cerr << "dentry cache mismatch" << std::endl;
+            return 1;
+        }
+    }
+
+    // 批量导入导出：宿主目录树整棵导入，再导出到另一个目录，内容逐字节一致
+    std::cout << "[import/export]" << std::endl;
+    {
+        namespace hostfs = std::filesystem;
+        hostfs::path src = hostfs::temp_directory_path() / "fs_import_src";
+        hostfs::path dst = hostfs::temp_directory_path() / "fs_export_dst";
+        hostfs::remove_all(src);
+        hostfs::remove_all(dst);
+        hostfs::create_directories(src / "docs" / "deep");
+        hostfs::create_directories(src / "empty_dir");
+        std::string big(2500000, '\0');
+        for (size_t i = 0; i < big.size(); ++i) big[i] = static_cast<char>(i * 31 % 251);
+        std::ofstream(src / "big.bin", std::ios::binary) << big;
+        std::ofstream(src / "docs" / "a.txt") << "alpha";
+        std::ofstream(src / "docs" / "deep" / "b.txt") << "beta";
+        std::ofstream(src / "empty.txt");
+
+        FileSystemContext host(8192);
+        host.importTree(src.string(), "/imported");
+        host.importTree(src.string(), "/imported");   // 已有的文件全部跳过
+        std::string a, copied;
+        host.streamFile("/imported/docs/a.txt", [&](const char* data, int n) { a.append(data, n); });
+        // 虚拟目录名可以是 ..，导出时跳过，不能写到目标目录之外
+        hostfs::path escape = hostfs::temp_directory_path() / "fs_export_escape.txt";
+        hostfs::remove(escape);
+        host.mkdir("/imported/..");
+        host.createFile("/imported/../fs_export_escape.txt", "outside");
+        host.exportTree("/imported", dst.string());
+        bool contained = !hostfs::exists(escape);
+        hostfs::remove(escape);
+        std::ifstream in(dst / "big.bin", std::ios::binary);
+        copied.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        std::ifstream deep(dst / "docs" / "deep" / "b.txt");
+        std::string b((std::istreambuf_iterator<char>(deep)), std::istreambuf_iterator<char>());
+        bool ok = a == "alpha" && copied == big && b == "beta" && contained && hostfs::is_directory(dst / "empty_dir") &&
+                  hostfs::file_size(dst / "empty.txt") == 0;
+        hostfs::remove_all(src);
+        hostfs::remove_all(dst);
+        if (!ok) {
+            std::cerr << "import/export mismatch" << std::endl;
+            return 1;
+        }
+    }
+
+    // 写时复制快照：改写共享的块时才复制，快照中的内容不变；回滚后回到快照时的状态，
+    // 回滚记入日志，不保存直接丢弃对象后重新加载，得到的是回滚后的状态
+    std::cout << "[snapshots]" << std::endl;
+    {
+        const std::string snapImage = "vdisk_snapshot.dat";
+        const std::string big(300000, 'a');   // 用到二级间接块
+        std::string afterRollback;
+        {
+            FileSystemContext host(4096);
+            host.save(snapImage);
+            host.mkdir("/data");
+            host.createFile("/data/big.bin", big);
+            host.createFile("/data/keep.txt", "v1");
+            host.snapshot("s1");
+            host.snapshot("s1");                   // 同名，被拒绝
+            Session s(host);
+            int fd = s.open("/data/big.bin");
+            s.seek(fd, 270000);
+            s.write(fd, "zzzz", 4);
+            s.close(fd);
+            s.appendFile("/data/keep.txt", " v2");
+            s.mkdir("/other");
+            host.rollback("s1");
+            bool restored = host.du("/other").dirs == 0 && host.du("/data").bytes == big.size() + 1 + 3;
+            std::string content;
+            host.streamFile("/data/big.bin", [&](const char* data, int n) { content.append(data, n); });
+            host.appendFile("/data/keep.txt", " v3");
+            host.streamFile("/data/keep.txt", [&](const char* data, int n) { afterRollback.append(data, n); });
+            if (!restored || content != big + '\0' || host.listSnapshots().size() != 1) {
+                std::cerr << "snapshot rollback mismatch" << std::endl;
+                return 1;
+            }
+        }
+        FileSystemContext reloaded;
+        reloaded.load(snapImage);
+        std::string keep, content;
+        reloaded.streamFile("/data/keep.txt", [&](const char* data, int n) { keep.append(data, n); });
+        reloaded.streamFile("/data/big.bin", [&](const char* data, int n) { content.append(data, n); });
+        bool ok = keep == afterRollback && content == big + '\0' && reloaded.du("/other").dirs == 0 &&
+                  reloaded.listSnapshots().empty();
+        std::remove(snapImage.c_str());
+        std::remove((snapImage + ".meta").c_str());
+        std::remove((snapImage + ".journal").c_str());
+        if (!ok) {
+            std::cerr << "snapshot recovery mismatch" << std::endl;
+            return 1;
+        }
+    }
+
+    // 预写日志：保存后继续修改但不再 save，直接丢弃对象模拟进程崩溃，重新加载时由日志恢复
+    std::cout << "[journal crash recovery]" << std::endl;
+    const std::string image = "vdisk_journal.dat";
+    {
+        FileSystemContext crashed;
+        crashed.save(image);
+        crashed.mkdir("/logs");
+        crashed.cd("/logs");
+        crashed.createFile("a.txt", "journaled write");
+        crashed.beginBatch();   // 11 个操作合并为一个批次
+        for (int i = 0; i < 10; ++i) crashed.appendFile("a.txt", " more");
+        crashed.createFile("b.txt", "batched");
+        crashed.endBatch();
+        crashed.mv("/logs/b.txt", "/c.txt");
+        const Journal::Stats& stats = crashed.getJournal().stats();
+        std::cout << "commits: " << stats.commits << ", records: " << stats.records
+                  << ", bytes: " << stats.bytes << std::endl;
+        if (stats.commits != 4) return 1;
+    }
+
+    FileSystemContext recovered;
+    recovered.load(image);
+    recovered.cd("/logs");
+    recovered.readFile("a.txt");
+    recovered.cd("/");
+    recovered.readFile("c.txt");
+
+    InodeManager inodes;
+    std::unique_ptr<Directory> tree;
+    uint64_t seq = 0;
+    metadata::load(image + ".meta", inodes, tree, DiskManager::BLOCK_SIZE, DiskManager::DEFAULT_BLOCK_COUNT, seq);
+    Directory* logs = tree->findSubdir("logs");
+    Inode* a = logs ? inodes.getInode(logs->findFile("a.txt")) : nullptr;
+    if (!a || a->size != 66 || tree->findFile("c.txt") == -1 || logs->findFile("b.txt") != -1 || seq != 4) {
+        std::cerr << "journal recovery mismatch" << std::endl;
+        return 1;
+    }
+
+    // 增量检查点：只改文件内容时元数据文件原地更新，目录树变化时新目录段追加在末尾
+    std::cout << "[incremental checkpoint]" << std::endl;
+    auto fileSize = [](const std::string& path) {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        return static_cast<long long>(in.tellg());
+    };
+    long long metaSize = fileSize(image + ".meta");
+    recovered.appendFile("c.txt", " again");
+    recovered.save(image);
+    bool inPlace = fileSize(image + ".meta") == metaSize && fileSize(image + ".journal") == 0;
+    recovered.mkdir("/archive");
+    recovered.save(image);
+    bool appended = fileSize(image + ".meta") > metaSize;
+    metadata::load(image + ".meta", inodes, tree, DiskManager::BLOCK_SIZE, DiskManager::DEFAULT_BLOCK_COUNT, seq);
+    Inode* c = inodes.getInode(tree->findFile("c.txt"));
+    if (!inPlace || !appended || !c || c->size != 14 || !tree->findSubdir("archive")) {
+        std::cerr << "incremental checkpoint mismatch" << std::endl;
+        return 1;
+    }
+    std::remove(image.c_str());
+    std::remove((image + ".meta").c_str());
+    std::remove((image + ".journal").c_str());
+
+    // 加载或打开失败时原来的文件系统保持原样：快照还在，之后的修改仍然记入原来的日志
+    std::cout << "[failed load keeps journal]" << std::endl;
+    {
+        const std::string kept = "vdisk_kept.dat";
+        {
+            FileSystemContext running;
+            running.save(kept);
+            running.snapshot("s");
+            running.load("vdisk_missing.dat");
+            running.mount("no_such_dir/vdisk.dat");
+            running.mkdir("/after");
+            if (running.listSnapshots().size() != 1) {
+                std::cerr << "failed load dropped snapshots" << std::endl;
+                return 1;
+            }
+        }
+        FileSystemContext reopened;
+        reopened.load(kept);
+        bool ok = reopened.du("/after").dirs == 1;
+        for (const char* suffix : {"", ".meta", ".journal"}) std::remove((kept + suffix).c_str());
+        if (!ok) {
+            std::cerr << "failed load journal mismatch" << std::endl;
+            return 1;
+        }
+    }
+
+    // 元数据损坏时 load 只报告失败，不抛出异常
+    std::cout << "[corrupted metadata]" << std::endl;
+    {
+        // 换上另一个块数不同的镜像的元数据
+        const std::string corrupt = "vdisk_corrupt.dat";
+        const std::string other = "vdisk_other.dat";
+        {
+            FileSystemContext larger(2048);
+            larger.save(corrupt);
+            FileSystemContext smaller;
+            smaller.save(other);
+        }
+        std::filesystem::copy_file(other + ".meta", corrupt + ".meta",
+                                   std::filesystem::copy_options::overwrite_existing);
+        for (const char* suffix : {"", ".meta", ".journal"}) std::remove((other + suffix).c_str());
+        bool threw = false;
+        try {
+            recovered.load(corrupt);
+        } catch (const std::exception&) {
+            threw = true;
+        }
+        std::remove(corrupt.c_str());
+        std::remove((corrupt + ".meta").c_str());
+        std::remove((corrupt + ".journal").c_str());
+        if (threw) {
+            std::cerr << "corrupted metadata mismatch" << std::endl;
+            return 1;
+        }
+    }
+
     return 0;
 }
\ No newline at end of file
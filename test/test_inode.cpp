@@ -1,9 +1,11 @@
 #include "inode.h"
 #include "disk.h"
+#include "inode_manager.h"
 #include <iostream>
 #include <iomanip>
 #include <ctime>
 #include <cstring>
+#include <string>
 
 void printTime(time_t t) {
     std::tm* tm_ptr = std::localtime(&t);
@@ -49,5 +51,121 @@ int main() {
     printTime(inode.modifyTime);
     std::cout << std::endl;
 
+    // 多块写入：块应连续分配，并按 extent 读写
+    Inode big;
+    std::string payload(5 * DiskManager::BLOCK_SIZE + 100, 'a');
+    for (size_t i = 0; i < payload.size(); ++i) payload[i] = static_cast<char>('a' + i % 26);
+    if (!big.writeData(disk, payload.data(), payload.size())) {
+        std::cerr << "Multi-block write failed." << std::endl;
+        return 1;
+    }
+    std::cout << "Extents:";
+    big.forEachExtent(disk, [](const Extent& ext) {
+        std::cout << " (" << ext.start << ", " << ext.length << ")";
+    });
+    std::cout << std::endl;
+
+    std::string back(payload.size(), '\0');
+    if (!big.readData(disk, &back[0], back.size()) || back != payload) {
+        std::cerr << "Multi-block read mismatch." << std::endl;
+        return 1;
+    }
+    std::cout << "Multi-block round trip: OK" << std::endl;
+
+    // 原地重写：等长内容沿用原来的块，缩短只释放多出的块
+    std::vector<int> before = big.getBlockMap(disk);
+    int freeBefore = disk.freeBlockCount();
+    std::string rewrite(payload.size(), 'r');
+    big.writeData(disk, rewrite);
+    bool sameBlocks = big.getBlockMap(disk) == before && disk.freeBlockCount() == freeBefore;
+    big.writeData(disk, rewrite.data(), 2 * DiskManager::BLOCK_SIZE);
+    bool shrunk = big.blockCount == 2 && big.blockAt(disk, 0) == before[0] && disk.freeBlockCount() == freeBefore + 4;
+    std::string shortBack(2 * DiskManager::BLOCK_SIZE, '\0');
+    big.read(disk, 0, shortBack.size(), &shortBack[0]);
+    if (!sameBlocks || !shrunk || shortBack != rewrite.substr(0, shortBack.size())) {
+        std::cerr << "In-place rewrite mismatch." << std::endl;
+        return 1;
+    }
+    std::cout << "In-place rewrite: OK" << std::endl;
+    big.writeData(disk, payload.data(), payload.size());
+
+    // 大文件：超过直接块与一级间接块的容量，需要二级间接块
+    DiskManager largeDisk(4096);
+    Inode huge;
+    int hugeSize = (Inode::DIRECT_BLOCKS + Inode::PTRS_PER_BLOCK + 100) * DiskManager::BLOCK_SIZE;
+    std::string hugeData(hugeSize, '\0');
+    for (int i = 0; i < hugeSize; ++i) hugeData[i] = static_cast<char>(i % 251);
+    if (!huge.writeData(largeDisk, hugeData.data(), hugeSize)) {
+        std::cerr << "Large write failed." << std::endl;
+        return 1;
+    }
+    std::string hugeBack(hugeSize, '\0');
+    if (!huge.readData(largeDisk, &hugeBack[0], hugeSize) || hugeBack != hugeData) {
+        std::cerr << "Large read mismatch." << std::endl;
+        return 1;
+    }
+    // 流式读取：按 extent 分段交出，拼起来与原内容一致；从中间偏移开始只交出剩余部分
+    std::string streamed;
+    int chunks = 0;
+    huge.readStream(largeDisk, 0, hugeSize, [&](const char* data, int n) {
+        streamed.append(data, n);
+        ++chunks;
+    });
+    std::string streamedTail;
+    huge.readStream(largeDisk, hugeSize - 1500, 4096, [&](const char* data, int n) {
+        streamedTail.append(data, n);
+    });
+    if (streamed != hugeData || streamedTail != hugeData.substr(hugeSize - 1500)) {
+        std::cerr << "Streamed read mismatch." << std::endl;
+        return 1;
+    }
+    std::cout << "Streamed " << streamed.size() << " bytes in " << chunks << " chunks" << std::endl;
+    std::cout << "Large file: " << huge.blockCount << " blocks, indirect " << huge.indirectBlock
+              << ", double indirect " << huge.doubleIndirectBlock << std::endl;
+    huge.clearData(largeDisk);
+    if (largeDisk.freeBlockCount() != largeDisk.getBlockCount()) {
+        std::cerr << "Blocks leaked after clearData." << std::endl;
+        return 1;
+    }
+    std::cout << "Large file cleared, all blocks free." << std::endl;
+
+    // 按偏移读写：追加只写新增部分，截断释放多余块
+    Inode log;
+    std::string expected;
+    for (int i = 0; i < 300; ++i) {
+        std::string rec = "record " + std::to_string(i) + "\n";
+        if (log.write(disk, log.size, rec.size(), rec.data()) != static_cast<int>(rec.size())) {
+            std::cerr << "Append write failed." << std::endl;
+            return 1;
+        }
+        expected += rec;
+    }
+    std::string middle(100, '\0');
+    int got = log.read(disk, 2000, 100, &middle[0]);
+    if (got != 100 || middle != expected.substr(2000, 100)) {
+        std::cerr << "Offset read mismatch." << std::endl;
+        return 1;
+    }
+    std::cout << "Appended " << log.size << " bytes in " << log.blockCount << " blocks" << std::endl;
+    log.truncate(disk, 1500);
+    std::cout << "Truncated to " << log.size << " bytes, " << log.blockCount << " blocks" << std::endl;
+    if (log.blockCount != 2) return 1;
+    log.clearData(disk);
+
+    // inode 表：释放的 id 被复用，表增长后已取得的指针仍然有效
+    InodeManager table;
+    int first = table.allocateInode(Inode::FILE);
+    Inode* firstNode = table.getInode(first);
+    for (int i = 0; i < 1000; ++i) table.allocateInode(Inode::FILE);
+    if (table.getInode(first) != firstNode) {
+        std::cerr << "Inode pointer moved while the table grew." << std::endl;
+        return 1;
+    }
+    table.deleteInode(500);
+    table.deleteInode(200);
+    int reused = table.allocateInode(Inode::DIRECTORY);
+    std::cout << "Inode table: " << table.inodeCount() << " live, reused id " << reused << std::endl;
+    if (reused != 200 || table.getInode(500) != nullptr || table.getInode(5000) != nullptr) return 1;
+
     return 0;
 }